@@ -0,0 +1,573 @@
+/*
+ * replay.c - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Replays a trace that was recorded with telex_trace_start() against the
+ * document snapshots next to it, and prints the throughput and latency of
+ * parsing and lookups in the same format as bench/suite. Lookups whose
+ * results differ from the recorded ones are counted as mismatches.
+ */
+
+#include <telex/telex.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+struct record {
+	char type;
+	unsigned long telex;
+	unsigned long doc;
+	long pos;
+	long result;
+	char *input;
+
+	/* limited and range lookups */
+	int err;
+	size_t max_bytes;
+	size_t max_lines;
+	unsigned long end_telex;
+	long end;
+
+	/* lookups through several telexes */
+	unsigned long *chain;
+	size_t chain_length;
+};
+
+struct document {
+	char *text;
+	size_t size;
+};
+
+struct replay {
+	struct record *records;
+	size_t num_records;
+
+	struct document *docs;
+	size_t num_docs;
+
+	struct telex **telexes;
+	const char **inputs;
+	size_t num_telexes;
+};
+
+struct samples {
+	double *values;
+	size_t num_values;
+	size_t bytes;
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void* grow(void *array, size_t *capacity, const size_t used, const size_t size)
+{
+	void *new;
+
+	if (used < *capacity) {
+		return array;
+	}
+
+	if (!(new = realloc(array, (*capacity ? *capacity * 2 : 64) * size))) {
+		return NULL;
+	}
+
+	*capacity = *capacity ? *capacity * 2 : 64;
+	return new;
+}
+
+static long parse_offset(const char *str)
+{
+	return strcmp(str, "-") == 0 ? -1 : atol(str);
+}
+
+static int valid_telex(struct replay *replay, const unsigned long telex)
+{
+	return telex && telex < replay->num_telexes;
+}
+
+static int parse_chain(struct replay *replay, struct record *record, const char *str)
+{
+	size_t i;
+	int len;
+
+	if (sscanf(str, "%zu%n", &record->chain_length, &len) != 1 ||
+	    !(record->chain = calloc(record->chain_length + 1, sizeof(*record->chain)))) {
+		return -1;
+	}
+
+	for (i = 0; i < record->chain_length; i++) {
+		str += len;
+
+		if (sscanf(str, "%lu%n", &record->chain[i], &len) != 1 ||
+		    !valid_telex(replay, record->chain[i])) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int load_document(struct document *doc, const char *trace_path,
+			 const unsigned long id, const size_t size)
+{
+	char path[4096];
+	FILE *file;
+	size_t len;
+
+	snprintf(path, sizeof(path), "%s.%lu", trace_path, id);
+
+	if (!(file = fopen(path, "r"))) {
+		fprintf(stderr, "Could not open %s; was the trace recorded with "
+			"TELEX_TRACE_DOCUMENTS?\n", path);
+		return -1;
+	}
+
+	if (!(doc->text = malloc(size + 1))) {
+		fclose(file);
+		return -1;
+	}
+
+	len = fread(doc->text, 1, size, file);
+	fclose(file);
+
+	if (len != size) {
+		fprintf(stderr, "%s is shorter than the recorded document\n", path);
+		return -1;
+	}
+
+	doc->text[size] = 0;
+	doc->size = size;
+	return 0;
+}
+
+static int load_trace(struct replay *replay, const char *path)
+{
+	size_t record_capacity;
+	size_t line_size;
+	size_t doc_capacity;
+	char *line;
+	int version;
+	FILE *file;
+	int err;
+
+	if (!(file = fopen(path, "r"))) {
+		perror(path);
+		return -1;
+	}
+
+	record_capacity = 0;
+	doc_capacity = 0;
+	line_size = 0;
+	line = NULL;
+	err = -1;
+
+	/* version 2 added limited, chained, and range lookups */
+	if (getline(&line, &line_size, file) < 0 ||
+	    sscanf(line, "telex-trace %d", &version) != 1 || version < 1 || version > 2) {
+		fprintf(stderr, "%s is not a trace\n", path);
+		goto cleanup;
+	}
+
+	while (getline(&line, &line_size, file) >= 0) {
+		struct record *record;
+		char pos[32];
+		char result[32];
+		char end[32];
+		size_t size;
+		int len;
+
+		if (!(replay->records = grow(replay->records, &record_capacity,
+					     replay->num_records, sizeof(*record)))) {
+			goto cleanup;
+		}
+
+		record = &replay->records[replay->num_records];
+		memset(record, 0, sizeof(*record));
+		record->type = line[0];
+
+		switch (line[0]) {
+		case 'P':
+			if (sscanf(line, "P %lu %zu", &record->telex, &size) != 2 ||
+			    !(record->input = malloc(size + 1)) ||
+			    fread(record->input, 1, size, file) != size || fgetc(file) != '\n') {
+				goto malformed;
+			}
+
+			record->input[size] = 0;
+
+			if (record->telex >= replay->num_telexes) {
+				replay->num_telexes = record->telex + 1;
+			}
+
+			break;
+
+		case 'D':
+			if (sscanf(line, "D %lu %zu", &record->doc, &size) != 2 ||
+			    record->doc != replay->num_docs + 1) {
+				goto malformed;
+			}
+
+			if (!(replay->docs = grow(replay->docs, &doc_capacity, replay->num_docs,
+						  sizeof(*replay->docs))) ||
+			    load_document(&replay->docs[replay->num_docs], path,
+					  record->doc, size) < 0) {
+				goto cleanup;
+			}
+
+			replay->num_docs++;
+			break;
+
+		case 'L':
+			if (sscanf(line, "L %lu %lu %31s %31s", &record->telex, &record->doc,
+				   pos, result) != 4 ||
+			    !record->doc || record->doc > replay->num_docs ||
+			    !record->telex || record->telex >= replay->num_telexes) {
+				goto malformed;
+			}
+
+			record->pos = parse_offset(pos);
+			record->result = parse_offset(result);
+			break;
+
+		case 'M':
+			if (sscanf(line, "M %lu %lu %31s %zu %zu %d %31s", &record->telex,
+				   &record->doc, pos, &record->max_bytes, &record->max_lines,
+				   &record->err, result) != 7 ||
+			    !record->doc || record->doc > replay->num_docs ||
+			    !valid_telex(replay, record->telex)) {
+				goto malformed;
+			}
+
+			record->pos = parse_offset(pos);
+			record->result = parse_offset(result);
+			break;
+
+		case 'A':
+			if (sscanf(line, "A %lu %31s %31s %n", &record->doc, pos, result, &len) != 3 ||
+			    !record->doc || record->doc > replay->num_docs ||
+			    parse_chain(replay, record, line + len) < 0) {
+				goto malformed;
+			}
+
+			record->pos = parse_offset(pos);
+			record->result = parse_offset(result);
+			break;
+
+		case 'R':
+			if (sscanf(line, "R %lu %lu %lu %31s %d %31s %31s", &record->telex,
+				   &record->end_telex, &record->doc, pos, &record->err,
+				   result, end) != 7 ||
+			    !record->doc || record->doc > replay->num_docs ||
+			    !valid_telex(replay, record->telex) ||
+			    !valid_telex(replay, record->end_telex)) {
+				goto malformed;
+			}
+
+			record->pos = parse_offset(pos);
+			record->result = parse_offset(result);
+			record->end = parse_offset(end);
+			break;
+
+		default:
+			goto malformed;
+		}
+
+		replay->num_records++;
+	}
+
+	if (!(replay->telexes = calloc(replay->num_telexes + 1, sizeof(*replay->telexes))) ||
+	    !(replay->inputs = calloc(replay->num_telexes + 1, sizeof(*replay->inputs)))) {
+		goto cleanup;
+	}
+
+	err = 0;
+	goto cleanup;
+
+malformed:
+	fprintf(stderr, "Malformed record in %s: %s", path, line);
+
+cleanup:
+	free(line);
+	fclose(file);
+	return err;
+}
+
+static void sample(struct samples *samples, const double value, const size_t bytes)
+{
+	samples->values[samples->num_values++] = value;
+	samples->bytes += bytes;
+}
+
+static long offset(struct document *doc, const char *pos)
+{
+	return pos ? pos - doc->text : -1;
+}
+
+static struct telex_range* parse_range(struct replay *replay, struct record *record)
+{
+	struct telex_error *errors;
+	struct telex_range *range;
+	char *input;
+
+	if (!replay->inputs[record->telex] || !replay->inputs[record->end_telex] ||
+	    !(input = malloc(strlen(replay->inputs[record->telex]) +
+			     strlen(replay->inputs[record->end_telex]) + 2))) {
+		return NULL;
+	}
+
+	sprintf(input, "%s,%s", replay->inputs[record->telex], replay->inputs[record->end_telex]);
+	errors = NULL;
+	range = NULL;
+
+	telex_range_parse(&range, input, &errors);
+	telex_error_free_all(&errors);
+	free(input);
+
+	return range;
+}
+
+/* returns 1 if the lookup did not return what was recorded */
+static int lookup(struct replay *replay, struct record *record, struct samples *lookups)
+{
+	struct telex_limits limits;
+	struct telex_range *range;
+	struct telex_span span;
+	struct telex **chain;
+	struct document *doc;
+	const char *result;
+	const char *pos;
+	double start;
+	size_t i;
+	int err;
+
+	doc = &replay->docs[record->doc - 1];
+	pos = record->pos < 0 ? NULL : doc->text + record->pos;
+
+	switch (record->type) {
+	case 'L':
+		if (!replay->telexes[record->telex]) {
+			return 1;
+		}
+
+		start = now();
+		result = telex_lookup(replay->telexes[record->telex], doc->text, doc->size, pos);
+		sample(lookups, now() - start, 0);
+
+		return offset(doc, result) != record->result;
+
+	case 'M':
+		if (!replay->telexes[record->telex]) {
+			return 1;
+		}
+
+		memset(&limits, 0, sizeof(limits));
+		limits.max_bytes = record->max_bytes;
+		limits.max_lines = record->max_lines;
+		result = NULL;
+
+		start = now();
+		err = telex_lookup_limited(replay->telexes[record->telex], doc->text, doc->size,
+					   pos, &limits, &result);
+		sample(lookups, now() - start, 0);
+
+		/* deadlines and cancellation are not recorded, so those lookups can't be compared */
+		if (record->err == -ETIMEDOUT || record->err == -ECANCELED) {
+			return 0;
+		}
+
+		return err != record->err || (err >= 0 && offset(doc, result) != record->result);
+
+	case 'A':
+		if (!(chain = calloc(record->chain_length + 1, sizeof(*chain)))) {
+			return 1;
+		}
+
+		for (i = 0; i < record->chain_length; i++) {
+			if (!(chain[i] = replay->telexes[record->chain[i]])) {
+				free(chain);
+				return 1;
+			}
+		}
+
+		start = now();
+		result = telex_lookup_array(chain, record->chain_length, doc->text, doc->size,
+					    pos, NULL);
+		sample(lookups, now() - start, 0);
+
+		free(chain);
+		return offset(doc, result) != record->result;
+
+	case 'R':
+		if (!(range = parse_range(replay, record))) {
+			return 1;
+		}
+
+		start = now();
+		err = telex_range_lookup(range, doc->text, doc->size, pos, &span);
+		sample(lookups, now() - start, 0);
+
+		telex_range_free(&range);
+		return err != record->err || (err >= 0 && (offset(doc, span.begin) != record->result ||
+							   offset(doc, span.end) != record->end));
+	}
+
+	return 0;
+}
+
+static long run(struct replay *replay, struct samples *parses, struct samples *lookups)
+{
+	long mismatches;
+	size_t i;
+
+	mismatches = 0;
+
+	for (i = 0; i < replay->num_records; i++) {
+		struct record *record;
+		double start;
+
+		record = &replay->records[i];
+
+		if (record->type == 'P') {
+			struct telex_error *errors;
+			struct telex *telex;
+
+			errors = NULL;
+			telex = NULL;
+
+			start = now();
+			telex_parse(&telex, record->input, &errors);
+			sample(parses, now() - start, strlen(record->input));
+
+			telex_error_free_all(&errors);
+
+			if (record->telex) {
+				telex_free(&replay->telexes[record->telex]);
+				replay->telexes[record->telex] = telex;
+				replay->inputs[record->telex] = record->input;
+			} else {
+				telex_free(&telex);
+			}
+		} else if (record->type != 'D') {
+			mismatches += lookup(replay, record, lookups);
+		}
+	}
+
+	return mismatches;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+	double x;
+	double y;
+
+	x = *(const double*)a;
+	y = *(const double*)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void report(const char *name, struct samples *samples)
+{
+	double total;
+	size_t i;
+
+	if (!samples->num_values) {
+		return;
+	}
+
+	for (total = 0, i = 0; i < samples->num_values; i++) {
+		total += samples->values[i];
+	}
+
+	qsort(samples->values, samples->num_values, sizeof(*samples->values), compare_doubles);
+
+	printf("%s\t%zu\t%.1f\t%.0f\t%.0f\t%.1f\t%.1f\n", name, samples->num_values,
+	       total / samples->num_values * 1e9, samples->num_values / total,
+	       samples->bytes / total, samples->values[samples->num_values / 2] * 1e9,
+	       samples->values[samples->num_values * 99 / 100] * 1e9);
+}
+
+int main(int argc, char *argv[])
+{
+	struct samples lookups;
+	struct samples parses;
+	struct replay replay;
+	long mismatches;
+	int repeat;
+	int opt;
+	int i;
+
+	repeat = 1;
+
+	while ((opt = getopt(argc, argv, "n:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			repeat = atoi(optarg);
+			break;
+
+		default:
+			fprintf(stderr, "Usage: %s [-n repetitions] trace\n", argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (optind + 1 != argc || repeat < 1) {
+		fprintf(stderr, "Usage: %s [-n repetitions] trace\n", argv[0]);
+		return 1;
+	}
+
+	memset(&replay, 0, sizeof(replay));
+	memset(&parses, 0, sizeof(parses));
+	memset(&lookups, 0, sizeof(lookups));
+
+	if (load_trace(&replay, argv[optind]) < 0 ||
+	    !(parses.values = malloc(replay.num_records * repeat * sizeof(double))) ||
+	    !(lookups.values = malloc(replay.num_records * repeat * sizeof(double)))) {
+		return 1;
+	}
+
+	for (mismatches = 0, i = 0; i < repeat; i++) {
+		mismatches += run(&replay, &parses, &lookups);
+	}
+
+	printf("operation\tops\tns/op\tops/s\tbytes/s\tp50_ns\tp99_ns\n");
+	report("parse", &parses);
+	report("lookup", &lookups);
+
+	for (i = 0; (size_t)i < replay.num_telexes; i++) {
+		telex_free(&replay.telexes[i]);
+	}
+
+	if (mismatches) {
+		fprintf(stderr, "%ld lookups returned different results than recorded\n", mismatches);
+		return 1;
+	}
+
+	return 0;
+}
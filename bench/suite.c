@@ -0,0 +1,627 @@
+/*
+ * suite.c - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Measures tokenizing, parsing, the evaluation primitives, telex_rlookup(),
+ * the line index of documents, anchor generation and telex_combine() on generated corpora. Every benchmark prints one
+ * tab-separated line, so that the output of two runs can be compared.
+ *
+ * Operations that take less than a microsecond are timed in batches, so
+ * their percentiles are those of the batch averages.
+ */
+
+#include <telex/telex.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "token.h"
+
+#define DEFAULT_CORPUS_SIZE (4 * 1024 * 1024)
+#define DEFAULT_DURATION    0.25
+#define MIN_BATCH_TIME      1e-6
+#define MAX_SAMPLES         100000
+#define MIN_SAMPLES         5
+
+#define FORWARD_MARK  "FWD-MARK"
+#define BACKWARD_MARK "BACK-MARK"
+
+struct corpus {
+	const char *name;
+	char *text;
+	size_t size;
+	long lines;
+};
+
+#define BATCH_POSITIONS 1024
+
+struct bench {
+	struct corpus *corpus;
+	char *input;
+	size_t input_len;
+	struct telex *telex;
+	struct telex *other;
+	const char *pos;
+	const char **positions;
+	struct telex_doc *doc;
+};
+
+struct benchmark {
+	const char *name;
+	int (*setup)(struct bench *bench);
+	size_t (*run)(struct bench *bench);
+};
+
+static uint32_t next_random(uint32_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t generate_log(char *text, const size_t size, uint32_t *state)
+{
+	static const char *levels[] = { "DEBUG", "INFO ", "WARN ", "ERROR" };
+	size_t len;
+
+	for (len = 0; len + 128 < size; ) {
+		uint32_t r;
+
+		r = next_random(state);
+		len += sprintf(text + len, "2023-06-%02u %02u:%02u:%02u.%03u %s [worker-%u] "
+			       "request %u handled in %u ms\n", r % 28 + 1, r % 24, r % 60,
+			       (r >> 8) % 60, (r >> 4) % 1000, levels[r % 4], (r >> 12) % 64,
+			       next_random(state) % 1000000, next_random(state) % 5000);
+	}
+
+	return len;
+}
+
+static size_t generate_source(char *text, const size_t size, uint32_t *state)
+{
+	size_t len;
+
+	for (len = 0; len + 128 < size; ) {
+		uint32_t r;
+
+		r = next_random(state);
+
+		switch (r % 4) {
+		case 0:
+			len += sprintf(text + len, "static int func_%u(struct obj_%u *obj)\n{\n",
+				       r % 10000, (r >> 8) % 100);
+			break;
+
+		case 1:
+			len += sprintf(text + len, "\tif (obj->field_%u > %u) {\n\t\treturn -%u;\n\t}\n\n",
+				       r % 32, (r >> 8) % 1000, (r >> 4) % 100);
+			break;
+
+		case 2:
+			len += sprintf(text + len, "\tobj->field_%u = helper_%u(obj, %u);\n",
+				       r % 32, (r >> 8) % 500, (r >> 4) % 4096);
+			break;
+
+		default:
+			len += sprintf(text + len, "\treturn 0;\n}\n\n");
+			break;
+		}
+	}
+
+	return len;
+}
+
+static size_t generate_minified(char *text, const size_t size, uint32_t *state)
+{
+	size_t len;
+
+	for (len = 0; len + 64 < size; ) {
+		uint32_t r;
+
+		r = next_random(state);
+		len += sprintf(text + len, "var a%u=function(b,c){return b.x%u+c[%u]||null};",
+			       r % 100000, (r >> 8) % 64, (r >> 4) % 256);
+	}
+
+	return len;
+}
+
+/* long runs of the same character, which are the worst case for naive searches */
+static size_t generate_repetitive(char *text, const size_t size, uint32_t *state)
+{
+	size_t len;
+
+	for (len = 0; len + 256 < size; ) {
+		size_t run;
+
+		run = 64 + next_random(state) % 128;
+		memset(text + len, 'a', run);
+		len += run;
+		text[len++] = '\n';
+	}
+
+	return len;
+}
+
+static int corpus_generate(struct corpus *corpus, const char *name, const size_t size,
+			   size_t (*generate)(char*, const size_t, uint32_t*))
+{
+	uint32_t state;
+	size_t len;
+	size_t i;
+
+	if (!(corpus->text = malloc(size + 1))) {
+		return -1;
+	}
+
+	state = 0x5eed;
+	len = generate(corpus->text, size, &state);
+	memset(corpus->text + len, ' ', size - len);
+	corpus->text[size] = 0;
+
+	memcpy(corpus->text + size / 10, BACKWARD_MARK, strlen(BACKWARD_MARK));
+	memcpy(corpus->text + size / 10 * 9, FORWARD_MARK, strlen(FORWARD_MARK));
+
+	corpus->name = name;
+	corpus->size = size;
+	corpus->lines = 1;
+
+	for (i = 0; i < size; i++) {
+		corpus->lines += corpus->text[i] == '\n';
+	}
+
+	return 0;
+}
+
+static int parse(struct telex **telex, const char *input)
+{
+	struct telex_error *errors;
+
+	errors = NULL;
+
+	if (telex_parse(telex, input, &errors) != 0) {
+		fprintf(stderr, "Could not parse %s\n", input);
+		telex_error_free_all(&errors);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int setup_input(struct bench *bench)
+{
+	size_t len;
+	int i;
+
+	if (!(bench->input = malloc(4096))) {
+		return -1;
+	}
+
+	for (len = 0, i = 0; i < 48; i++) {
+		len += sprintf(bench->input + len, "%s:%d>\"word%d\"|\"other%d\">#%d<<'re%d'",
+			       i ? ">" : "", i + 1, i, i, i % 80, i);
+	}
+
+	bench->input_len = len;
+	return 0;
+}
+
+static size_t run_tokenize(struct bench *bench)
+{
+	struct telex_error *errors;
+	struct token *tokens;
+
+	errors = NULL;
+	tokens = tokenize(bench->input, &errors);
+	token_free_all(tokens);
+
+	return bench->input_len;
+}
+
+static size_t run_parse(struct bench *bench)
+{
+	struct telex *telex;
+
+	if (parse(&telex, bench->input) == 0) {
+		telex_free(&telex);
+	}
+
+	return bench->input_len;
+}
+
+static size_t run_lookup(struct bench *bench)
+{
+	struct telex_stats stats;
+
+	telex_lookup_stats(bench->telex, bench->corpus->text, bench->corpus->size,
+			   bench->pos, &stats);
+
+	return stats.bytes_scanned;
+}
+
+static int setup_string_forward(struct bench *bench)
+{
+	return parse(&bench->telex, "\"" FORWARD_MARK "\"");
+}
+
+static int setup_string_backward(struct bench *bench)
+{
+	bench->pos = bench->corpus->text + bench->corpus->size - 1;
+	return parse(&bench->telex, "<\"" BACKWARD_MARK "\"");
+}
+
+static int setup_nocase_forward(struct bench *bench)
+{
+	return parse(&bench->telex, "\"fwd-mark\"i");
+}
+
+static int setup_nocase_backward(struct bench *bench)
+{
+	bench->pos = bench->corpus->text + bench->corpus->size - 1;
+	return parse(&bench->telex, "<\"back-mark\"i");
+}
+
+static int setup_near_miss(struct bench *bench)
+{
+	return parse(&bench->telex, "\"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab\"");
+}
+
+static int setup_line_forward(struct bench *bench)
+{
+	char input[64];
+
+	snprintf(input, sizeof(input), ":%ld", bench->corpus->lines * 9 / 10);
+	return parse(&bench->telex, input);
+}
+
+static int setup_line_backward(struct bench *bench)
+{
+	char input[64];
+
+	bench->pos = bench->corpus->text + bench->corpus->size - 1;
+	snprintf(input, sizeof(input), "<:%ld", bench->corpus->lines * 9 / 10);
+	return parse(&bench->telex, input);
+}
+
+static int setup_column(struct bench *bench)
+{
+	return parse(&bench->telex, "#4096");
+}
+
+static int setup_or_fallback(struct bench *bench)
+{
+	return parse(&bench->telex, "\"MISSING-MARK\"|\"" FORWARD_MARK "\"");
+}
+
+static int setup_rlookup(struct bench *bench)
+{
+	bench->pos = bench->corpus->text + bench->corpus->size / 2;
+	return 0;
+}
+
+static size_t run_rlookup(struct bench *bench)
+{
+	struct telex *telex;
+
+	if (telex_rlookup(&telex, bench->corpus->text, bench->pos) == 0) {
+		telex_free(&telex);
+	}
+
+	return bench->pos - bench->corpus->text;
+}
+
+static int setup_rlookup_batch(struct bench *bench)
+{
+	size_t i;
+
+	if (!(bench->positions = malloc(BATCH_POSITIONS * sizeof(*bench->positions)))) {
+		return -1;
+	}
+
+	for (i = 0; i < BATCH_POSITIONS; i++) {
+		bench->positions[i] = bench->corpus->text + bench->corpus->size / BATCH_POSITIONS * i;
+	}
+
+	return 0;
+}
+
+static size_t run_rlookup_batch(struct bench *bench)
+{
+	struct telex *telexes[BATCH_POSITIONS];
+	size_t i;
+
+	if (telex_rlookup_batch(telexes, bench->corpus->text, bench->positions,
+				BATCH_POSITIONS) == 0) {
+		for (i = 0; i < BATCH_POSITIONS; i++) {
+			telex_free(&telexes[i]);
+		}
+	}
+
+	return bench->positions[BATCH_POSITIONS - 1] - bench->corpus->text;
+}
+
+static int setup_doc_lines(struct bench *bench)
+{
+	bench->pos = bench->corpus->text + bench->corpus->size / 2;
+
+	if (telex_doc_new(&bench->doc, bench->corpus->text, bench->corpus->size) < 0) {
+		return -1;
+	}
+
+	return telex_doc_build_lines(bench->doc, 0) < 0 ? -1 : 0;
+}
+
+static size_t run_doc_rlookup(struct bench *bench)
+{
+	struct telex *telex;
+
+	if (telex_doc_rlookup(bench->doc, &telex, bench->pos) == 0) {
+		telex_free(&telex);
+	}
+
+	return bench->pos - bench->corpus->text;
+}
+
+static size_t run_doc_offset(struct bench *bench)
+{
+	size_t offset;
+
+	telex_doc_position_to_offset(bench->doc, bench->corpus->lines / 2, 0, &offset);
+	return bench->pos - bench->corpus->text;
+}
+
+static int setup_anchor(struct bench *bench)
+{
+	if (setup_doc_lines(bench) < 0) {
+		return -1;
+	}
+
+	return telex_doc_build_index(bench->doc) < 0 ? -1 : 0;
+}
+
+static size_t run_anchor(struct bench *bench)
+{
+	struct telex *telex;
+
+	if (telex_anchor_generate(&telex, bench->doc, bench->pos, 8) == 0) {
+		telex_free(&telex);
+	}
+
+	return 0;
+}
+
+static int setup_combine(struct bench *bench)
+{
+	if (parse(&bench->telex, ":120>\"word\"|\"other\">#4") < 0) {
+		return -1;
+	}
+
+	return parse(&bench->other, ">>\"x\"<:2>'re'");
+}
+
+static size_t run_combine(struct bench *bench)
+{
+	struct telex *combined;
+
+	if (telex_combine(&combined, bench->telex, bench->other) == 0) {
+		telex_free(&combined);
+	}
+
+	return 0;
+}
+
+static struct benchmark benchmarks[] = {
+	{ "tokenize",        setup_input,           run_tokenize },
+	{ "parse",           setup_input,           run_parse },
+	{ "string-forward",  setup_string_forward,  run_lookup },
+	{ "string-backward", setup_string_backward, run_lookup },
+	{ "nocase-forward",  setup_nocase_forward,  run_lookup },
+	{ "nocase-backward", setup_nocase_backward, run_lookup },
+	{ "string-near-miss", setup_near_miss,      run_lookup },
+	{ "line-forward",    setup_line_forward,    run_lookup },
+	{ "line-backward",   setup_line_backward,   run_lookup },
+	{ "column",          setup_column,          run_lookup },
+	{ "or-fallback",     setup_or_fallback,     run_lookup },
+	{ "rlookup",         setup_rlookup,         run_rlookup },
+	{ "rlookup-batch",   setup_rlookup_batch,   run_rlookup_batch },
+	{ "doc-rlookup",     setup_doc_lines,       run_doc_rlookup },
+	{ "doc-offset",      setup_doc_lines,       run_doc_offset },
+	{ "anchor",          setup_anchor,          run_anchor },
+	{ "combine",         setup_combine,         run_combine },
+};
+
+static int compare_doubles(const void *a, const void *b)
+{
+	double x;
+	double y;
+
+	x = *(const double*)a;
+	y = *(const double*)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int measure(struct benchmark *benchmark, struct bench *bench, const double duration,
+		   double *samples)
+{
+	size_t num_samples;
+	size_t batch;
+	size_t bytes;
+	double elapsed;
+	double begin;
+	size_t i;
+
+	/* also the warm-up */
+	for (batch = 1; ; batch *= 2) {
+		double start;
+
+		start = now();
+
+		for (i = 0; i < batch; i++) {
+			benchmark->run(bench);
+		}
+
+		if (now() - start >= MIN_BATCH_TIME) {
+			break;
+		}
+	}
+
+	bytes = benchmark->run(bench);
+	elapsed = 0;
+	begin = now();
+
+	for (num_samples = 0; num_samples < MAX_SAMPLES; num_samples++) {
+		double start;
+		double end;
+
+		if (num_samples >= MIN_SAMPLES && now() - begin >= duration) {
+			break;
+		}
+
+		start = now();
+
+		for (i = 0; i < batch; i++) {
+			benchmark->run(bench);
+		}
+
+		end = now();
+		samples[num_samples] = (end - start) / batch;
+		elapsed += end - start;
+	}
+
+	qsort(samples, num_samples, sizeof(*samples), compare_doubles);
+
+	printf("%s\t%s\t%zu\t%zu\t%.1f\t%.0f\t%.1f\t%.1f\n", benchmark->name, bench->corpus->name,
+	       num_samples * batch, bytes, elapsed / (num_samples * batch) * 1e9,
+	       bytes / (elapsed / (num_samples * batch)),
+	       samples[num_samples / 2] * 1e9, samples[num_samples * 99 / 100] * 1e9);
+	fflush(stdout);
+
+	return 0;
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr, "Usage: %s [-s corpus-size] [-t seconds] [benchmark...]\n", argv0);
+}
+
+int main(int argc, char *argv[])
+{
+	struct corpus corpora[4];
+	double duration;
+	double *samples;
+	size_t size;
+	size_t i;
+	size_t j;
+	int opt;
+
+	size = DEFAULT_CORPUS_SIZE;
+	duration = DEFAULT_DURATION;
+
+	while ((opt = getopt(argc, argv, "s:t:h")) != -1) {
+		switch (opt) {
+		case 's':
+			size = strtoul(optarg, NULL, 0);
+			break;
+
+		case 't':
+			duration = atof(optarg);
+			break;
+
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (size < 1024) {
+		fprintf(stderr, "The corpus size must be at least 1024 bytes\n");
+		return 1;
+	}
+
+	if (!(samples = malloc(MAX_SAMPLES * sizeof(*samples))) ||
+	    corpus_generate(&corpora[0], "log", size, generate_log) < 0 ||
+	    corpus_generate(&corpora[1], "source", size, generate_source) < 0 ||
+	    corpus_generate(&corpora[2], "minified", size, generate_minified) < 0 ||
+	    corpus_generate(&corpora[3], "repetitive", size, generate_repetitive) < 0) {
+		fprintf(stderr, "Could not generate the corpora\n");
+		return 1;
+	}
+
+	printf("benchmark\tcorpus\tops\tbytes/op\tns/op\tbytes/s\tp50_ns\tp99_ns\n");
+
+	for (i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+		int selected;
+		int k;
+
+		for (selected = optind == argc, k = optind; k < argc; k++) {
+			selected |= strcmp(argv[k], benchmarks[i].name) == 0;
+		}
+
+		if (!selected) {
+			continue;
+		}
+
+		for (j = 0; j < sizeof(corpora) / sizeof(corpora[0]); j++) {
+			struct bench bench;
+			int err;
+
+			memset(&bench, 0, sizeof(bench));
+			bench.corpus = &corpora[j];
+
+			if ((err = benchmarks[i].setup(&bench)) == 0) {
+				measure(&benchmarks[i], &bench, duration, samples);
+			}
+
+			telex_free(&bench.telex);
+			telex_free(&bench.other);
+			telex_doc_free(&bench.doc);
+			free(bench.positions);
+			free(bench.input);
+
+			if (err < 0) {
+				return 1;
+			}
+
+			/* the input of the parser does not depend on the corpus */
+			if (benchmarks[i].run == run_tokenize || benchmarks[i].run == run_parse) {
+				break;
+			}
+		}
+	}
+
+	for (j = 0; j < sizeof(corpora) / sizeof(corpora[0]); j++) {
+		free(corpora[j].text);
+	}
+
+	free(samples);
+	return 0;
+}
@@ -0,0 +1,300 @@
+/*
+ * threads.c - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Looks up the same telexes from 1 to N threads at the same time, both
+ * directly and through a shared document handle, and compares every
+ * result with the result of a single-threaded lookup. The document is
+ * looked up in without a cache, with a cache that holds every telex, and
+ * with one that holds only half of them, so that most lookups miss it.
+ */
+
+#include <telex/telex.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TEXT_SIZE    (4 * 1024 * 1024)
+#define NUM_TELEXES  64
+#define ITERATIONS   400
+
+enum mode {
+	MODE_LOOKUP = 0,
+	MODE_DOC,
+	MODE_CACHE_HITS,
+	MODE_CACHE_MISSES,
+	MODE_MAX
+};
+
+static const struct {
+	const char *name;
+	size_t cache_entries;
+} modes[MODE_MAX] = {
+	[MODE_LOOKUP]       = { "lookup", 0 },
+	[MODE_DOC]          = { "doc", 0 },
+	[MODE_CACHE_HITS]   = { "cache-hits", NUM_TELEXES },
+	[MODE_CACHE_MISSES] = { "cache-misses", NUM_TELEXES / 2 }
+};
+
+struct bench {
+	const char *text;
+	size_t size;
+	struct telex_doc *doc;
+	struct telex *telexes[NUM_TELEXES];
+	const char *expected[NUM_TELEXES];
+	enum mode mode;
+};
+
+struct worker {
+	struct bench *bench;
+	pthread_t thread;
+	int seed;
+	long mismatches;
+};
+
+static uint32_t next_random(uint32_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+static char* generate_text(const size_t size)
+{
+	uint32_t state;
+	size_t len;
+	char *text;
+
+	if (!(text = malloc(size + 1))) {
+		return NULL;
+	}
+
+	state = 0x7e1e7;
+
+	for (len = 0; len + 16 < size; ) {
+		len += sprintf(text + len, "w%u", next_random(&state) % 4096);
+		text[len++] = next_random(&state) % 12 ? ' ' : '\n';
+	}
+
+	memset(text + len, '\n', size - len);
+	text[size] = 0;
+
+	return text;
+}
+
+static int parse_telexes(struct bench *bench)
+{
+	uint32_t state;
+	int i;
+
+	state = 0xbe7c4;
+
+	for (i = 0; i < NUM_TELEXES; i++) {
+		struct telex_error *errors;
+		char input[128];
+
+		switch (i % 4) {
+		case 0:
+			snprintf(input, sizeof(input), "\"w%u \"", next_random(&state) % 4096);
+			break;
+
+		case 1:
+			snprintf(input, sizeof(input), ":%u>\"w%u\"",
+				 next_random(&state) % 40000 + 1, next_random(&state) % 4096);
+			break;
+
+		case 2:
+			snprintf(input, sizeof(input), ":%u>#%u", next_random(&state) % 60000 + 1,
+				 next_random(&state) % 40);
+			break;
+
+		default:
+			snprintf(input, sizeof(input), "\"w%u\"|\"w%u\">>\"w\"<<#2",
+				 next_random(&state) % 4096, next_random(&state) % 4096);
+			break;
+		}
+
+		if (telex_parse(&bench->telexes[i], input, &errors) != 0) {
+			fprintf(stderr, "Could not parse %s\n", input);
+			return -1;
+		}
+
+		bench->expected[i] = telex_lookup(bench->telexes[i], bench->text, bench->size, NULL);
+	}
+
+	return 0;
+}
+
+static void* worker_main(void *data)
+{
+	struct worker *worker;
+	struct bench *bench;
+	int i;
+
+	worker = (struct worker*)data;
+	bench = worker->bench;
+
+	for (i = 0; i < ITERATIONS; i++) {
+		struct telex *telex;
+		const char *result;
+		int idx;
+
+		/* every thread walks the telexes in a different order */
+		idx = (i * 7 + worker->seed) % NUM_TELEXES;
+		telex = bench->telexes[idx];
+
+		if (bench->mode == MODE_LOOKUP) {
+			result = telex_lookup(telex, bench->text, bench->size, NULL);
+		} else {
+			result = telex_doc_lookup(bench->doc, telex, NULL);
+		}
+
+		if (result != bench->expected[idx]) {
+			worker->mismatches++;
+		}
+	}
+
+	return NULL;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long run(struct bench *bench, const int num_threads, double *elapsed)
+{
+	struct worker *workers;
+	long mismatches;
+	double start;
+	int i;
+
+	if (!(workers = calloc(num_threads, sizeof(*workers)))) {
+		return -1;
+	}
+
+	start = now();
+
+	for (i = 0; i < num_threads; i++) {
+		workers[i].bench = bench;
+		workers[i].seed = i * 13;
+		pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+	}
+
+	for (mismatches = 0, i = 0; i < num_threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		mismatches += workers[i].mismatches;
+	}
+
+	*elapsed = now() - start;
+	free(workers);
+
+	return mismatches;
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench bench;
+	long mismatches;
+	int max_threads;
+	enum mode mode;
+	int i;
+
+	max_threads = argc > 1 ? atoi(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (max_threads < 1) {
+		max_threads = 1;
+	}
+
+	memset(&bench, 0, sizeof(bench));
+	bench.size = TEXT_SIZE;
+
+	if (!(bench.text = generate_text(bench.size)) ||
+	    parse_telexes(&bench) < 0 ||
+	    telex_doc_new(&bench.doc, bench.text, bench.size) < 0) {
+		fprintf(stderr, "Could not set up the benchmark\n");
+		return 1;
+	}
+
+	printf("mode\tthreads\tlookups/s\tspeedup\n");
+	mismatches = 0;
+
+	for (mode = MODE_LOOKUP; mode < MODE_MAX; mode++) {
+		double base;
+
+		/* walking the telexes in a cycle evicts every entry from a cache that is too small */
+		if (telex_doc_cache(bench.doc, modes[mode].cache_entries) < 0) {
+			fprintf(stderr, "Could not set up the cache\n");
+			return 1;
+		}
+
+		/* a cache that holds every telex is filled first, so that only hits are measured */
+		if (mode == MODE_CACHE_HITS) {
+			for (i = 0; i < NUM_TELEXES; i++) {
+				telex_doc_lookup(bench.doc, bench.telexes[i], NULL);
+			}
+		}
+
+		bench.mode = mode;
+		base = 0;
+
+		for (i = 1; i <= max_threads; i++) {
+			double elapsed;
+			double rate;
+			long errors;
+
+			if ((errors = run(&bench, i, &elapsed)) < 0) {
+				fprintf(stderr, "Could not run the benchmark\n");
+				return 1;
+			}
+
+			mismatches += errors;
+			rate = (double)i * ITERATIONS / elapsed;
+
+			if (i == 1) {
+				base = rate;
+			}
+
+			printf("%s\t%d\t%.0f\t%.2f\n", modes[mode].name, i, rate, rate / base);
+		}
+	}
+
+	for (i = 0; i < NUM_TELEXES; i++) {
+		telex_free(&bench.telexes[i]);
+	}
+
+	telex_doc_free(&bench.doc);
+	free((char*)bench.text);
+
+	if (mismatches) {
+		fprintf(stderr, "%ld lookups returned wrong results\n", mismatches);
+		return 1;
+	}
+
+	return 0;
+}
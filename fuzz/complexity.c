@@ -0,0 +1,561 @@
+/*
+ * complexity.c - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Looks for inputs whose cost grows faster than their size. An input is a
+ * telex, optionally followed by a NUL byte and the seed of a document.
+ * The telex is repeated into a compound telex of n and 4n bytes, which is
+ * parsed and combined, and the seed is repeated into documents of n and
+ * 4n bytes, in which the telex is looked up. For lookups, the strings in
+ * the telex and the seed are also stretched by the same factor as the
+ * document, by repeating every byte, so that searches whose cost grows
+ * with the length of the string are caught. Every phase costs the time
+ * it takes. If the cost at 4n is more than the given ratio times the cost
+ * at n, the input is flagged.
+ *
+ * Built with -DTELEX_LIBFUZZER and -fsanitize=fuzzer, flagged inputs stop
+ * libFuzzer, which saves them. Otherwise, the inputs are read from files,
+ * or generated from them with -g, and flagged ones are written to -o.
+ */
+
+#include <telex/telex.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "telex.h"
+
+#define DEFAULT_RATIO    8.0
+#define MIN_TIME         20e-6
+#define MAX_TELEX_SIZE   (64 * 1024)
+#define MAX_DOC_SIZE     (16 * 1024 * 1024)
+#define TELEX_BASE_SIZE  256
+#define DOC_BASE_SIZE    (16 * 1024)
+#define STRETCH_SIZE     1024
+#define REPETITIONS      3
+#define MAX_INPUT_SIZE   4096
+
+struct input {
+	char *telex;
+	size_t telex_len;
+	const char *seed;
+	size_t seed_len;
+};
+
+struct growth {
+	const char *phase;
+	size_t size;
+	double cost;
+	double cost_4n;
+};
+
+typedef double (*cost_fn)(struct input *input, const size_t size);
+
+static double max_ratio = DEFAULT_RATIO;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* the telex, repeated into a compound telex of at least size bytes */
+static char* repeat_telex(struct input *input, const size_t size)
+{
+	size_t len;
+	char *str;
+
+	if (!(str = malloc(size + input->telex_len + 2))) {
+		return NULL;
+	}
+
+	for (len = 0; len < size || !len; ) {
+		if (len) {
+			str[len++] = '>';
+		}
+
+		memcpy(str + len, input->telex, input->telex_len);
+		len += input->telex_len;
+	}
+
+	str[len] = 0;
+	return str;
+}
+
+/* the seed with every byte repeated factor times, repeated into a document of size bytes */
+static char* repeat_seed(struct input *input, const size_t size, const size_t factor)
+{
+	size_t len;
+	char *text;
+	size_t i;
+
+	if (!(text = malloc(size + 1))) {
+		return NULL;
+	}
+
+	for (len = 0, i = 0; len < size; len++, i++) {
+		text[len] = input->seed[i / factor % input->seed_len];
+	}
+
+	text[size] = 0;
+	return text;
+}
+
+/* the telex with every byte in its strings repeated factor times */
+static char* stretch_telex(struct input *input, const size_t factor)
+{
+	size_t len;
+	char quote;
+	char *str;
+	size_t i;
+	size_t k;
+
+	if (!(str = malloc(input->telex_len * factor + 1))) {
+		return NULL;
+	}
+
+	for (len = 0, quote = 0, i = 0; i < input->telex_len; i++) {
+		char chr;
+
+		chr = input->telex[i];
+
+		if (!quote || chr == quote) {
+			quote = quote ? 0 : chr == '"' || chr == '\'' ? chr : 0;
+			str[len++] = chr;
+			continue;
+		}
+
+		/* escapes are repeated as a whole */
+		for (k = 0; k < factor; k++) {
+			str[len++] = chr;
+
+			if (chr == '\\' && i + 1 < input->telex_len) {
+				str[len++] = input->telex[i + 1];
+			}
+		}
+
+		if (chr == '\\') {
+			i++;
+		}
+	}
+
+	str[len] = 0;
+	return str;
+}
+
+static struct telex* parse(const char *str)
+{
+	struct telex_error *errors;
+	struct telex *telex;
+
+	errors = NULL;
+	telex = NULL;
+
+	if (telex_parse(&telex, str, &errors) != 0) {
+		telex_error_free_all(&errors);
+		return NULL;
+	}
+
+	return telex;
+}
+
+static double cost_parse(struct input *input, const size_t size)
+{
+	struct telex *telex;
+	double best;
+	double start;
+	char *str;
+	int i;
+
+	if (!(str = repeat_telex(input, size))) {
+		return -1;
+	}
+
+	for (best = -1, i = 0; i < REPETITIONS; i++) {
+		start = now();
+		telex = parse(str);
+		telex_free(&telex);
+
+		if (best < 0 || now() - start < best) {
+			best = now() - start;
+		}
+	}
+
+	free(str);
+	return best;
+}
+
+static double cost_combine(struct input *input, const size_t size)
+{
+	struct telex *combined;
+	struct telex *right;
+	struct telex *left;
+	double best;
+	double start;
+	char *str;
+	int i;
+
+	if (!(str = repeat_telex(input, size))) {
+		return -1;
+	}
+
+	left = parse(str);
+	right = parse(">:1");
+	free(str);
+	best = 0;
+
+	for (i = 0; left && right && i < REPETITIONS; i++) {
+		start = now();
+
+		if (telex_combine(&combined, left, right) == 0) {
+			telex_free(&combined);
+		}
+
+		if (!i || now() - start < best) {
+			best = now() - start;
+		}
+	}
+
+	telex_free(&left);
+	telex_free(&right);
+
+	return best;
+}
+
+static double cost_lookup(struct input *input, const size_t size)
+{
+	struct telex *telex;
+	const char *pos;
+	size_t factor;
+	double best;
+	double start;
+	char *text;
+	char *str;
+	int i;
+
+	/* strings grow by a byte for every STRETCH_SIZE bytes, but never beyond the document */
+	factor = size / (input->telex_len > STRETCH_SIZE ? input->telex_len : STRETCH_SIZE);
+
+	if (!(str = stretch_telex(input, factor))) {
+		return -1;
+	}
+
+	telex = parse(str);
+	free(str);
+
+	if (!telex) {
+		return 0;
+	}
+
+	if (!(text = repeat_seed(input, size, factor))) {
+		telex_free(&telex);
+		return -1;
+	}
+
+	/* relative telexes start at the end of the document if they search backwards */
+	pos = NULL;
+
+	if (telex->prefix) {
+		pos = telex->prefix->type == TOKEN_LESS || telex->prefix->type == TOKEN_DLESS ?
+			text + size - 1 : text;
+	}
+
+	for (best = -1, i = 0; i < REPETITIONS; i++) {
+		start = now();
+		telex_lookup(telex, text, size, pos);
+
+		if (best < 0 || now() - start < best) {
+			best = now() - start;
+		}
+	}
+
+	telex_free(&telex);
+	free(text);
+
+	return best;
+}
+
+/* grows the size until the cost can be measured, then measures it at 4 times the size */
+static int measure(struct input *input, const char *phase, cost_fn cost, size_t size,
+		   const size_t max_size, const double min_cost, struct growth *growth)
+{
+	growth->phase = phase;
+
+	for (;;) {
+		if ((growth->cost = cost(input, size)) < 0) {
+			return -1;
+		}
+
+		if (growth->cost >= min_cost || size * 8 > max_size) {
+			break;
+		}
+
+		size *= 2;
+	}
+
+	growth->size = size;
+
+	if ((growth->cost_4n = cost(input, size * 4)) < 0) {
+		return -1;
+	}
+
+	return growth->cost >= min_cost && growth->cost_4n > growth->cost * max_ratio;
+}
+
+static void report(const char *name, struct growth *growth, const int flagged)
+{
+	/* times are measured in seconds, and reported in nanoseconds */
+	printf("%s\t%s\t%zu\tns\t%.3f\t%.3f\t%.2f\t%s\n", name, growth->phase, growth->size,
+	       growth->cost / growth->size * 1e9,
+	       growth->cost_4n / (growth->size * 4) * 1e9,
+	       growth->cost ? growth->cost_4n / growth->cost : 0, flagged ? "SUPERLINEAR" : "ok");
+}
+
+/* returns 1 if the input is flagged */
+static int check(const char *name, const uint8_t *data, const size_t size, const int verbose)
+{
+	struct growth growth;
+	struct input input;
+	const uint8_t *nul;
+	int flagged;
+	int result;
+
+	if (!size || size > MAX_INPUT_SIZE) {
+		return 0;
+	}
+
+	if (!(input.telex = malloc(size + 1))) {
+		return -1;
+	}
+
+	nul = memchr(data, 0, size);
+	input.telex_len = nul ? (size_t)(nul - data) : size;
+	memcpy(input.telex, data, input.telex_len);
+	input.telex[input.telex_len] = 0;
+
+	input.seed = nul && nul + 1 < data + size ? (const char*)nul + 1 : "line\n";
+	input.seed_len = nul && nul + 1 < data + size ? size - input.telex_len - 1 : 5;
+
+	/* NULs in the seed would end the document early */
+	if (memchr(input.seed, 0, input.seed_len) || !input.telex_len) {
+		free(input.telex);
+		return 0;
+	}
+
+	flagged = 0;
+
+	if ((result = measure(&input, "parse", cost_parse, TELEX_BASE_SIZE,
+			      MAX_TELEX_SIZE, MIN_TIME, &growth)) >= 0 && (verbose || result)) {
+		report(name, &growth, result);
+	}
+
+	flagged |= result > 0;
+
+	if ((result = measure(&input, "combine", cost_combine, TELEX_BASE_SIZE,
+			      MAX_TELEX_SIZE, MIN_TIME, &growth)) >= 0 && (verbose || result)) {
+		report(name, &growth, result);
+	}
+
+	flagged |= result > 0;
+
+	if ((result = measure(&input, "lookup", cost_lookup, DOC_BASE_SIZE,
+			      MAX_DOC_SIZE, MIN_TIME, &growth)) >= 0 && (verbose || result)) {
+		report(name, &growth, result);
+	}
+
+	flagged |= result > 0;
+
+	free(input.telex);
+	return flagged;
+}
+
+#ifdef TELEX_LIBFUZZER
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	if (check("input", data, size, 0) > 0) {
+		/* makes libFuzzer save the input */
+		abort();
+	}
+
+	return 0;
+}
+
+#else /* !TELEX_LIBFUZZER */
+
+static const char *fragments[] = {
+	"\"", "'", "<", "<<", ">", ">>", ":", "#", "|", "(", ")", " ", "\n",
+	"1", "12", "999999", "a", "ab", "\"a\"", "\"aaaa\"", "#-1", ":0", "\\",
+	"*", "2*", "@", "@1", "i", "\"A\"i"
+};
+
+static uint32_t next_random(uint32_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+/* splices fragments of telex syntax into a copy of the input */
+static size_t mutate(uint8_t *data, size_t size, const size_t max_size, uint32_t *state)
+{
+	int edits;
+
+	for (edits = next_random(state) % 4 + 1; edits > 0; edits--) {
+		const char *fragment;
+		size_t offset;
+		size_t len;
+
+		fragment = fragments[next_random(state) % (sizeof(fragments) / sizeof(fragments[0]))];
+		len = strlen(fragment);
+		offset = size ? next_random(state) % (size + 1) : 0;
+
+		if (next_random(state) % 3 == 0 && size > 0 && offset < size) {
+			/* removes a byte instead */
+			memmove(data + offset, data + offset + 1, size - offset - 1);
+			size--;
+			continue;
+		}
+
+		if (size + len > max_size) {
+			break;
+		}
+
+		memmove(data + offset + len, data + offset, size - offset);
+		memcpy(data + offset, fragment, len);
+		size += len;
+	}
+
+	return size;
+}
+
+static uint8_t* read_file(const char *path, size_t *size)
+{
+	uint8_t *data;
+	FILE *file;
+
+	if (!(file = fopen(path, "r"))) {
+		perror(path);
+		return NULL;
+	}
+
+	if ((data = malloc(MAX_INPUT_SIZE + 1))) {
+		*size = fread(data, 1, MAX_INPUT_SIZE + 1, file);
+	}
+
+	fclose(file);
+	return data;
+}
+
+static void write_file(const char *dir, const uint8_t *data, const size_t size,
+		       const unsigned long number)
+{
+	char path[4096];
+	FILE *file;
+
+	snprintf(path, sizeof(path), "%s/superlinear-%lu-%lu", dir, (unsigned long)time(NULL), number);
+
+	if ((file = fopen(path, "w"))) {
+		fwrite(data, 1, size, file);
+		fclose(file);
+		fprintf(stderr, "Saved %s\n", path);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	const char *output;
+	unsigned long generate;
+	unsigned long i;
+	int num_flagged;
+	uint32_t state;
+	int opt;
+	int k;
+
+	output = NULL;
+	generate = 0;
+	state = 0xc0ffee;
+
+	while ((opt = getopt(argc, argv, "g:o:r:h")) != -1) {
+		switch (opt) {
+		case 'g':
+			generate = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'o':
+			output = optarg;
+			break;
+
+		case 'r':
+			max_ratio = atof(optarg);
+			break;
+
+		default:
+			fprintf(stderr, "Usage: %s [-r ratio] [-g iterations] [-o dir] input...\n",
+				argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	printf("input\tphase\tn\tunit\tcost/byte(n)\tcost/byte(4n)\tratio\tresult\n");
+	num_flagged = 0;
+
+	for (k = optind; k < argc; k++) {
+		uint8_t *data;
+		size_t size;
+		int flagged;
+
+		if (!(data = read_file(argv[k], &size))) {
+			return 1;
+		}
+
+		if ((flagged = check(argv[k], data, size, !generate)) > 0) {
+			num_flagged++;
+		}
+
+		for (i = 0; i < generate; i++) {
+			uint8_t mutated[MAX_INPUT_SIZE];
+			size_t mutated_size;
+
+			memcpy(mutated, data, size < sizeof(mutated) ? size : sizeof(mutated));
+			mutated_size = mutate(mutated, size < sizeof(mutated) ? size : sizeof(mutated),
+					      sizeof(mutated), &state);
+
+			if (check(argv[k], mutated, mutated_size, 0) > 0) {
+				num_flagged++;
+
+				if (output) {
+					write_file(output, mutated, mutated_size, i);
+				}
+			}
+		}
+
+		free(data);
+	}
+
+	return num_flagged ? 1 : 0;
+}
+
+#endif /* !TELEX_LIBFUZZER */
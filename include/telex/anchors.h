@@ -0,0 +1,57 @@
+/*
+ * telex/anchors.h - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef TELEX_ANCHORS_H
+#define TELEX_ANCHORS_H
+
+#include <telex/doc.h>
+#include <stddef.h>
+
+struct telex;
+struct telex_anchors;
+
+typedef enum {
+	TELEX_ANCHOR_INVALID = 0,
+	TELEX_ANCHOR_UNCHANGED,
+	TELEX_ANCHOR_MOVED,
+	TELEX_ANCHOR_BROKEN
+} telex_anchor_status_t;
+
+int telex_anchors_new(struct telex_anchors **anchors);
+void telex_anchors_free(struct telex_anchors **anchors);
+
+int telex_anchors_add(struct telex_anchors *anchors, struct telex *telex, const size_t offset);
+int telex_anchors_remove(struct telex_anchors *anchors, const int id);
+
+int telex_anchors_resolve(struct telex_anchors *anchors, struct telex_doc *doc);
+telex_anchor_status_t telex_anchors_get(struct telex_anchors *anchors, const int id,
+					size_t *offset);
+/* the number of distinct steps that the anchors are made of */
+size_t telex_anchors_num_nodes(const struct telex_anchors *anchors);
+
+/*
+ * Generates a telex that finds pos through the shortest string near it
+ * that does not occur in the slack lines above it. Without a line index
+ * in doc, the text up to pos is scanned every time.
+ */
+int telex_anchor_generate(struct telex **telex, struct telex_doc *doc, const char *pos,
+			  const size_t slack);
+
+#endif /* TELEX_ANCHORS_H */
@@ -0,0 +1,49 @@
+/*
+ * telex/batch.h - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef TELEX_BATCH_H
+#define TELEX_BATCH_H
+
+#include <stddef.h>
+
+struct telex;
+
+/* a document is either read from path, or taken from start and size */
+struct telex_batch_doc {
+	const char *path;
+	const char *start;
+	size_t size;
+};
+
+struct telex_batch_result {
+	int error;
+	size_t offset;
+};
+
+/*
+ * Every telex is looked up from the start of every document, the way
+ * telex_lookup(telex, start, size, start) does. results has num_docs rows
+ * of num_telexes results each.
+ */
+int telex_batch_lookup(struct telex **telexes, const int num_telexes,
+		       const struct telex_batch_doc *docs, const size_t num_docs,
+		       struct telex_batch_result *results, const int num_threads);
+
+#endif /* TELEX_BATCH_H */
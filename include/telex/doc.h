@@ -0,0 +1,65 @@
+/*
+ * telex/doc.h - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef TELEX_DOC_H
+#define TELEX_DOC_H
+
+#include <stddef.h>
+
+struct telex;
+struct telex_doc;
+struct telex_range;
+struct telex_span;
+
+int telex_doc_new(struct telex_doc **doc, const char *start, const size_t size);
+void telex_doc_free(struct telex_doc **doc);
+
+int telex_doc_build_index(struct telex_doc *doc);
+int telex_doc_save_index(struct telex_doc *doc, const char *path);
+int telex_doc_load_index(struct telex_doc *doc, const char *path);
+void telex_doc_drop_index(struct telex_doc *doc);
+
+int telex_doc_spill_trigrams(struct telex_doc *doc, const char *path, const size_t memory_limit);
+int telex_doc_build_trigrams(struct telex_doc *doc, const size_t max_bytes);
+void telex_doc_drop_trigrams(struct telex_doc *doc);
+
+/* remembers where every interval-th line starts; 0 picks a default interval */
+int telex_doc_build_lines(struct telex_doc *doc, const size_t interval);
+void telex_doc_drop_lines(struct telex_doc *doc);
+
+int telex_doc_parallel(struct telex_doc *doc, const int num_threads, const size_t chunk_size);
+
+int telex_doc_cache(struct telex_doc *doc, const size_t max_entries);
+int telex_doc_edit(struct telex_doc *doc, const char *start, const size_t size,
+		   const size_t offset, const size_t removed_len, const size_t inserted_len);
+
+/* lookups may run concurrently, but not at the same time as any of the above */
+const char* telex_doc_lookup(struct telex_doc *doc, struct telex *telex, const char *pos);
+int telex_doc_lookup_range(struct telex_doc *doc, struct telex_range *range, const char *pos,
+			   struct telex_span *span);
+int telex_doc_rlookup(struct telex_doc *doc, struct telex **telex, const char *pos);
+
+/* lines start at 1, columns at 0 */
+int telex_doc_offset_to_position(struct telex_doc *doc, const size_t offset,
+				 size_t *line, size_t *col);
+int telex_doc_position_to_offset(struct telex_doc *doc, const size_t line, const size_t col,
+				 size_t *offset);
+
+#endif /* TELEX_DOC_H */
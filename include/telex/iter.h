@@ -0,0 +1,48 @@
+/*
+ * telex/iter.h - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef TELEX_ITER_H
+#define TELEX_ITER_H
+
+#include <stddef.h>
+
+struct telex;
+
+/* the members are private; the telex and the text must not change while iterating */
+struct telex_iter {
+	struct telex *telex;
+	const char *start;
+	size_t size;
+	int backward;
+
+	const char *pos;
+	const char *last;
+};
+
+/*
+ * Iterates over every position that the telex leads to from pos or any
+ * position after it, or before it if the telex searches backwards. The
+ * hits are those of its first step, so matches of a string may overlap.
+ */
+int telex_iter_init(struct telex_iter *iter, struct telex *telex,
+		    const char *start, const size_t size, const char *pos);
+const char* telex_iter_next(struct telex_iter *iter);
+
+#endif /* TELEX_ITER_H */
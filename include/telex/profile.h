@@ -0,0 +1,45 @@
+/*
+ * telex/profile.h - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef TELEX_PROFILE_H
+#define TELEX_PROFILE_H
+
+#include <stddef.h>
+
+struct telex;
+struct telex_profile;
+
+/*
+ * A profile accumulates the time and the bytes scanned of every step and
+ * every alternative of a telex over any number of lookups. The telex must
+ * not be freed before the profile, and a profile must not be used by more
+ * than one thread at a time.
+ */
+int telex_profile_new(struct telex_profile **profile, struct telex *telex);
+void telex_profile_free(struct telex_profile **profile);
+void telex_profile_reset(struct telex_profile *profile);
+
+const char* telex_profile_lookup(struct telex_profile *profile, const char *start,
+				 const size_t size, const char *pos);
+
+/* writes one line per step and alternative, like snprintf() */
+int telex_profile_to_string(struct telex_profile *profile, char *str, const size_t str_size);
+
+#endif /* TELEX_PROFILE_H */
@@ -0,0 +1,42 @@
+/*
+ * telex/resume.h - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef TELEX_RESUME_H
+#define TELEX_RESUME_H
+
+#include <stddef.h>
+
+struct telex;
+struct telex_eval;
+
+typedef enum {
+	TELEX_EVAL_ERROR = 0,
+	TELEX_EVAL_IN_PROGRESS,
+	TELEX_EVAL_DONE
+} telex_eval_status_t;
+
+/* the telex and the text must not be freed or changed until the evaluation has been freed */
+int telex_eval_start(struct telex_eval **eval, struct telex *telex,
+		     const char *start, const size_t size, const char *pos);
+telex_eval_status_t telex_eval_step(struct telex_eval *eval, const size_t budget_bytes);
+int telex_eval_result(struct telex_eval *eval, const char **result);
+void telex_eval_free(struct telex_eval **eval);
+
+#endif /* TELEX_RESUME_H */
@@ -0,0 +1,65 @@
+/*
+ * telex/stats.h - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef TELEX_STATS_H
+#define TELEX_STATS_H
+
+#include <stddef.h>
+
+#define TELEX_STATS_PRIMARIES 16
+
+typedef enum {
+	TELEX_SEARCH_SCAN = 0,
+	TELEX_SEARCH_PARALLEL,
+	TELEX_SEARCH_SUFFIX_INDEX,
+	TELEX_SEARCH_TRIGRAM_INDEX,
+	TELEX_SEARCH_MAX
+} telex_search_t;
+
+struct telex_stats {
+	size_t bytes_scanned;
+	size_t newlines_crossed;
+	size_t alternatives_tried;
+	size_t alternatives_failed;
+
+	/* string searches, by the algorithm that was used for them */
+	size_t searches[TELEX_SEARCH_MAX];
+
+	/* bytes scanned by the first primary expressions, in the order they were evaluated */
+	size_t num_primaries;
+	size_t primary_bytes[TELEX_STATS_PRIMARIES];
+};
+
+struct telex_stats_totals {
+	size_t lookups;
+	size_t primaries;
+	size_t bytes_scanned;
+	size_t newlines_crossed;
+	size_t alternatives_tried;
+	size_t alternatives_failed;
+	size_t searches[TELEX_SEARCH_MAX];
+};
+
+/* while enabled, all lookups add to the process-wide totals */
+void telex_stats_collect(const int enable);
+void telex_stats_get_totals(struct telex_stats_totals *totals);
+void telex_stats_reset_totals(void);
+
+#endif /* TELEX_STATS_H */
@@ -22,14 +22,43 @@
 #define TELEX_TELEX_H
 
 #include <telex/error.h>
+#include <telex/doc.h>
+#include <telex/anchors.h>
+#include <telex/batch.h>
+#include <telex/resume.h>
+#include <telex/stats.h>
+#include <telex/profile.h>
+#include <telex/trace.h>
+#include <telex/iter.h>
 #include <stddef.h>
+#include <time.h>
 
 struct telex;
+struct telex_range;
+
+/*
+ * Limits for telex_lookup_limited(). Zero means no limit. The deadline is
+ * measured against CLOCK_MONOTONIC, and a lookup stops as soon as another
+ * thread sets *cancel to a non-zero value.
+ *
+ * telex_lookup_limited() returns 0 and sets *result to the position that
+ * was found, or returns a negative error and sets *result to NULL. Unless
+ * the arguments are invalid, *result is always written.
+ */
+struct telex_limits {
+	size_t max_bytes;
+	size_t max_lines;
+	struct timespec deadline;
+	const int *cancel;
+};
 
 int telex_parse(struct telex **telex,
                 const char *input,
                 struct telex_error **errors);
 int telex_rlookup(struct telex **telex, const char *start, const char *pos);
+/* positions must be sorted in ascending order; all of them are counted in one pass */
+int telex_rlookup_batch(struct telex **telexes, const char *start,
+			const char **positions, const size_t num_positions);
 
 void telex_debug(struct telex *telex);
 void telex_free(struct telex **telex);
@@ -39,10 +68,54 @@ int telex_combine(struct telex **combined, const struct telex *left, const struc
 struct telex* telex_clone(const struct telex *telex);
 void telex_simplify(struct telex *telex);
 
+struct telex_span {
+	const char *begin;
+	const char *end;
+};
+
+/*
+ * A range is two telexes separated by a comma, as in "BEGIN","END". Its end
+ * is looked up from where its start leads, in the same pass.
+ */
+int telex_range_parse(struct telex_range **range,
+		      const char *input,
+		      struct telex_error **errors);
+void telex_range_free(struct telex_range **range);
+int telex_range_to_string(struct telex_range *range, char *str, const size_t str_size);
+/* fills in *span with the text from the start of the range to its end */
+int telex_range_lookup(struct telex_range *range, const char *start, const size_t size,
+		       const char *pos, struct telex_span *span);
+
+/*
+ * Lookups never modify a telex, so a telex may be looked up by any number
+ * of threads at the same time.
+ */
 const char* telex_lookup(struct telex *telex, const char *start,
                          const size_t size, const char *pos);
+int telex_lookup_limited(struct telex *telex, const char *start, const size_t size,
+			 const char *pos, const struct telex_limits *limits,
+			 const char **result);
+/* like telex_lookup(), and fills in *stats with the work the lookup did */
+const char* telex_lookup_stats(struct telex *telex, const char *start, const size_t size,
+			       const char *pos, struct telex_stats *stats);
+/*
+ * Like telex_lookup(), and fills in *span with the text the last primary
+ * expression covered: the string it matched, the line it moved to, or the
+ * characters it moved over.
+ */
+const char* telex_lookup_span(struct telex *telex, const char *start, const size_t size,
+			      const char *pos, struct telex_span *span);
 const char* telex_lookup_multi(const char *start, const size_t size,
                                const char *pos, int n, ...);
+/*
+ * Like telex_lookup_multi(). If positions is not NULL, it receives the
+ * position after every step of every telex, so it needs room for as many
+ * positions as telex_num_steps() of all telexes adds up to. The positions
+ * of steps that were not reached are NULL.
+ */
+const char* telex_lookup_array(struct telex **telexes, const size_t n, const char *start,
+			       const size_t size, const char *pos, const char **positions);
 int telex_is_relative(const struct telex *telex);
+int telex_num_steps(const struct telex *telex);
 
 #endif /* TELEX_TELEX_H */
@@ -0,0 +1,41 @@
+/*
+ * telex/trace.h - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef TELEX_TRACE_H
+#define TELEX_TRACE_H
+
+/* also write every document the first time it is looked up in, to path.<id> */
+#define TELEX_TRACE_DOCUMENTS (1 << 0)
+
+/*
+ * While a trace is being recorded, telex_parse(), the telex_lookup() family,
+ * telex_lookup_limited(), telex_lookup_array(), telex_range_lookup() and
+ * their telex_doc_*() counterparts append their inputs and results to the
+ * file at path. Of the limits, only max_bytes and max_lines are recorded.
+ * Documents are told apart by their address and size, so a document that
+ * is changed in place must be moved or resized to be recorded again.
+ *
+ * telex_lookup_multi(), batch, resumable and profiled lookups, iterators,
+ * and reverse lookups are not recorded.
+ */
+int telex_trace_start(const char *path, const int flags);
+void telex_trace_stop(void);
+
+#endif /* TELEX_TRACE_H */
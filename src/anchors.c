@@ -0,0 +1,744 @@
+/*
+ * anchors.c - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#define _GNU_SOURCE
+#include <telex/anchors.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "telex.h"
+#include "eval.h"
+#include "doc.h"
+#include "search.h"
+
+/*
+ * The steps of all anchors are kept in a trie, so that anchors that share
+ * a sequence of leading steps share the evaluation of those steps. All
+ * anchors are evaluated from the start of the document.
+ *
+ * Many anchors start with an absolute line expression. Those are not
+ * evaluated one by one but in a single sweep over the document, in the
+ * order of their line numbers.
+ */
+
+struct anchor_node {
+	struct anchor_node *next;
+	struct anchor_node *parent;
+	struct anchor_node *children;
+	struct anchor_node *sibling;
+
+	uint64_t hash;
+	token_type_t prefix;
+	struct compound_expr *step;
+
+	int users;
+	unsigned int generation;
+	int error;
+	const char *result;
+};
+
+struct anchor {
+	struct anchor_node *node;
+	size_t offset;
+	telex_anchor_status_t status;
+};
+
+struct telex_anchors {
+	struct anchor *anchors;
+	int num_anchors;
+	int max_anchors;
+
+	struct anchor_node root;
+	struct anchor_node **buckets;
+	size_t num_buckets;
+	size_t num_nodes;
+	unsigned int generation;
+};
+
+static uint64_t anchor_node_hash(const struct anchor_node *parent, const token_type_t prefix,
+				 const struct or_expr *expr)
+{
+	uint64_t hash;
+
+	hash = or_expr_hash(0xcbf29ce484222325ULL, expr);
+	hash ^= (uintptr_t)parent * 0x9e3779b97f4a7c15ULL;
+	hash ^= (uint64_t)prefix << 56;
+
+	return hash;
+}
+
+int telex_anchors_new(struct telex_anchors **anchors)
+{
+	struct telex_anchors *new;
+
+	if (!anchors) {
+		return -EINVAL;
+	}
+
+	if (!(new = calloc(1, sizeof(*new)))) {
+		return -ENOMEM;
+	}
+
+	new->num_buckets = 64;
+
+	if (!(new->buckets = calloc(new->num_buckets, sizeof(*new->buckets)))) {
+		free(new);
+		return -ENOMEM;
+	}
+
+	*anchors = new;
+	return 0;
+}
+
+static void anchor_node_free(struct anchor_node *node)
+{
+	while (node->children) {
+		struct anchor_node *child;
+
+		child = node->children;
+		node->children = child->sibling;
+
+		anchor_node_free(child);
+		compound_expr_free(&child->step);
+		free(child);
+	}
+}
+
+void telex_anchors_free(struct telex_anchors **anchors)
+{
+	if (anchors && *anchors) {
+		anchor_node_free(&(*anchors)->root);
+		free((*anchors)->buckets);
+		free((*anchors)->anchors);
+		free(*anchors);
+		*anchors = NULL;
+	}
+}
+
+static int anchors_grow_buckets(struct telex_anchors *anchors)
+{
+	struct anchor_node **buckets;
+	size_t num_buckets;
+	size_t i;
+
+	num_buckets = anchors->num_buckets * 2;
+
+	if (!(buckets = calloc(num_buckets, sizeof(*buckets)))) {
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < anchors->num_buckets; i++) {
+		while (anchors->buckets[i]) {
+			struct anchor_node *node;
+
+			node = anchors->buckets[i];
+			anchors->buckets[i] = node->next;
+
+			node->next = buckets[node->hash & (num_buckets - 1)];
+			buckets[node->hash & (num_buckets - 1)] = node;
+		}
+	}
+
+	free(anchors->buckets);
+	anchors->buckets = buckets;
+	anchors->num_buckets = num_buckets;
+
+	return 0;
+}
+
+static struct anchor_node* anchors_get_node(struct telex_anchors *anchors,
+					    struct anchor_node *parent,
+					    const token_type_t prefix,
+					    struct or_expr *expr)
+{
+	struct anchor_node *node;
+	struct or_expr *clone;
+	uint64_t hash;
+
+	hash = anchor_node_hash(parent, prefix, expr);
+
+	for (node = anchors->buckets[hash & (anchors->num_buckets - 1)]; node; node = node->next) {
+		if (node->hash == hash && node->parent == parent && node->prefix == prefix &&
+		    or_expr_equal(node->step->or_expr, expr)) {
+			return node;
+		}
+	}
+
+	if (anchors->num_nodes >= anchors->num_buckets * 2 &&
+	    anchors_grow_buckets(anchors) < 0) {
+		return NULL;
+	}
+
+	if (!(node = calloc(1, sizeof(*node)))) {
+		return NULL;
+	}
+
+	/* the prefix is stored in the node, so that the step doesn't need one */
+	if (!(clone = or_expr_clone(expr)) ||
+	    !(node->step = compound_expr_new(NULL, NULL, clone))) {
+		or_expr_free(&clone);
+		free(node);
+		return NULL;
+	}
+
+	node->hash = hash;
+	node->prefix = prefix;
+	node->parent = parent;
+	node->sibling = parent->children;
+	parent->children = node;
+
+	node->next = anchors->buckets[hash & (anchors->num_buckets - 1)];
+	anchors->buckets[hash & (anchors->num_buckets - 1)] = node;
+	anchors->num_nodes++;
+
+	return node;
+}
+
+/* only called once the node has no users, and thus no children either */
+static void anchors_drop_node(struct telex_anchors *anchors, struct anchor_node *node)
+{
+	struct anchor_node **link;
+
+	for (link = &node->parent->children; *link != node; link = &(*link)->sibling);
+	*link = node->sibling;
+
+	for (link = &anchors->buckets[node->hash & (anchors->num_buckets - 1)]; *link != node;
+	     link = &(*link)->next);
+	*link = node->next;
+
+	compound_expr_free(&node->step);
+	free(node);
+	anchors->num_nodes--;
+}
+
+int telex_anchors_add(struct telex_anchors *anchors, struct telex *telex, const size_t offset)
+{
+	struct compound_expr **steps;
+	struct anchor_node *parent;
+	struct anchor_node *child;
+	struct anchor_node *node;
+	token_type_t prefix;
+	int num_steps;
+	int i;
+
+	if (!anchors || !telex) {
+		return -EINVAL;
+	}
+
+	if (anchors->num_anchors == anchors->max_anchors) {
+		struct anchor *new;
+		int max_anchors;
+
+		max_anchors = anchors->max_anchors ? anchors->max_anchors * 2 : 64;
+
+		if (!(new = realloc(anchors->anchors, max_anchors * sizeof(*new)))) {
+			return -ENOMEM;
+		}
+
+		anchors->anchors = new;
+		anchors->max_anchors = max_anchors;
+	}
+
+	if ((num_steps = compound_expr_flatten(telex->compound_expr, &steps)) < 0) {
+		return num_steps;
+	}
+
+	prefix = telex->prefix ? telex->prefix->type : TOKEN_INVALID;
+	node = &anchors->root;
+
+	for (i = 0; i < num_steps; i++) {
+		token_type_t effective_prefix;
+
+		effective_prefix = steps[i]->prefix ? steps[i]->prefix->type : prefix;
+
+		if (!(child = anchors_get_node(anchors, node, effective_prefix, steps[i]->or_expr))) {
+			/* the nodes created for the earlier steps don't have users yet */
+			for (; node != &anchors->root && !node->users; node = parent) {
+				parent = node->parent;
+				anchors_drop_node(anchors, node);
+			}
+
+			free(steps);
+			return -ENOMEM;
+		}
+
+		node = child;
+	}
+
+	free(steps);
+
+	anchors->anchors[anchors->num_anchors].node = node;
+	anchors->anchors[anchors->num_anchors].offset = offset;
+	anchors->anchors[anchors->num_anchors].status = TELEX_ANCHOR_UNCHANGED;
+
+	for (; node != &anchors->root; node = node->parent) {
+		node->users++;
+	}
+
+	return anchors->num_anchors++;
+}
+
+int telex_anchors_remove(struct telex_anchors *anchors, const int id)
+{
+	struct anchor_node *parent;
+	struct anchor_node *node;
+
+	if (!anchors || id < 0 || id >= anchors->num_anchors ||
+	    !anchors->anchors[id].node) {
+		return -EINVAL;
+	}
+
+	/* a node has at least as many users as any of its children */
+	for (node = anchors->anchors[id].node; node != &anchors->root; node = parent) {
+		parent = node->parent;
+
+		if (!--node->users) {
+			anchors_drop_node(anchors, node);
+		}
+	}
+
+	anchors->anchors[id].node = NULL;
+	anchors->anchors[id].status = TELEX_ANCHOR_INVALID;
+
+	return 0;
+}
+
+static int compare_line_nodes(const void *a, const void *b)
+{
+	long long line_a;
+	long long line_b;
+
+	line_a = (*(struct anchor_node**)a)->step->or_expr->primary_expr->line_expr->integer->integer;
+	line_b = (*(struct anchor_node**)b)->step->or_expr->primary_expr->line_expr->integer->integer;
+
+	return line_a < line_b ? -1 : line_a > line_b;
+}
+
+static int is_absolute_line_node(struct anchor_node *node)
+{
+	struct or_expr *expr;
+
+	expr = node->step->or_expr;
+
+	return node->users > 0 && node->prefix == TOKEN_INVALID && !expr->or_expr &&
+		expr->primary_expr->line_expr && expr->primary_expr->line_expr->integer &&
+		expr->primary_expr->line_expr->integer->integer > 0;
+}
+
+static int anchors_sweep_lines(struct telex_anchors *anchors, struct eval_context *ctx)
+{
+	struct anchor_node **nodes;
+	struct anchor_node *node;
+	const char *cur;
+	const char *end;
+	long long line;
+	size_t num_nodes;
+	size_t i;
+
+	for (num_nodes = 0, node = anchors->root.children; node; node = node->sibling) {
+		num_nodes += is_absolute_line_node(node);
+	}
+
+	if (!num_nodes) {
+		return 0;
+	}
+
+	if (!(nodes = malloc(num_nodes * sizeof(*nodes)))) {
+		return -ENOMEM;
+	}
+
+	for (i = 0, node = anchors->root.children; node; node = node->sibling) {
+		if (is_absolute_line_node(node)) {
+			nodes[i++] = node;
+		}
+	}
+
+	qsort(nodes, num_nodes, sizeof(*nodes), compare_line_nodes);
+
+	cur = ctx->start;
+	end = ctx->start + ctx->size;
+	line = 1;
+
+	for (i = 0; i < num_nodes; i++) {
+		long long target;
+
+		target = nodes[i]->step->or_expr->primary_expr->line_expr->integer->integer;
+
+		while (line < target && cur < end) {
+			const char *newline;
+
+			if (!(newline = memchr(cur, '\n', end - cur))) {
+				cur = end;
+				break;
+			}
+
+			cur = newline + 1;
+			line++;
+		}
+
+		nodes[i]->result = cur;
+		nodes[i]->error = 0;
+		nodes[i]->generation = anchors->generation;
+	}
+
+	free(nodes);
+	return 0;
+}
+
+static void anchors_resolve_node(struct telex_anchors *anchors, struct anchor_node *parent,
+				 struct eval_context *ctx)
+{
+	struct anchor_node *node;
+
+	for (node = parent->children; node; node = node->sibling) {
+		if (!node->users) {
+			continue;
+		}
+
+		if (node->generation != anchors->generation) {
+			node->error = eval_compound_step(node->step, ctx, parent->result,
+							 node->prefix, &node->result);
+			node->generation = anchors->generation;
+		}
+
+		/* children of nodes that could not be resolved stay unresolved */
+		if (!node->error) {
+			anchors_resolve_node(anchors, node, ctx);
+		}
+	}
+}
+
+int telex_anchors_resolve(struct telex_anchors *anchors, struct telex_doc *doc)
+{
+	struct eval_context ctx;
+	int changed;
+	int err;
+	int i;
+
+	if (!anchors || !doc) {
+		return -EINVAL;
+	}
+
+	eval_context_init(&ctx, doc->start, doc->size, doc);
+
+	/* zero means "never resolved", so skip it when wrapping around */
+	if (!++anchors->generation) {
+		anchors->generation++;
+	}
+
+	anchors->root.result = doc->start;
+	anchors->root.generation = anchors->generation;
+
+	if ((err = anchors_sweep_lines(anchors, &ctx)) < 0) {
+		return err;
+	}
+
+	anchors_resolve_node(anchors, &anchors->root, &ctx);
+
+	for (changed = 0, i = 0; i < anchors->num_anchors; i++) {
+		struct anchor *anchor;
+		size_t offset;
+
+		anchor = &anchors->anchors[i];
+
+		if (!anchor->node) {
+			continue;
+		}
+
+		if (anchor->node->generation != anchors->generation || anchor->node->error) {
+			anchor->status = TELEX_ANCHOR_BROKEN;
+			changed++;
+			continue;
+		}
+
+		offset = anchor->node->result - doc->start;
+
+		if (offset != anchor->offset) {
+			anchor->status = TELEX_ANCHOR_MOVED;
+			anchor->offset = offset;
+			changed++;
+		} else {
+			anchor->status = TELEX_ANCHOR_UNCHANGED;
+		}
+	}
+
+	return changed;
+}
+
+size_t telex_anchors_num_nodes(const struct telex_anchors *anchors)
+{
+	return anchors ? anchors->num_nodes : 0;
+}
+
+telex_anchor_status_t telex_anchors_get(struct telex_anchors *anchors, const int id,
+					size_t *offset)
+{
+	if (!anchors || id < 0 || id >= anchors->num_anchors) {
+		return TELEX_ANCHOR_INVALID;
+	}
+
+	if (offset) {
+		*offset = anchors->anchors[id].offset;
+	}
+
+	return anchors->anchors[id].status;
+}
+
+/*
+ * Generated anchors start at an absolute line above pos and search for a
+ * string from there. The string has to be taken from the text near pos and
+ * must not occur between the start of that line and itself, so that the
+ * search finds pos even if lines above it were removed or added.
+ *
+ * Small windows are simply scanned for earlier occurrences of the string.
+ * In large ones, the occurrences are looked up in the suffix index of the
+ * document, if it has one.
+ */
+
+#define ANCHOR_MAX_CONTEXT 64
+#define ANCHOR_MAX_SHIFT   32
+
+struct context {
+	size_t start;
+	size_t len;
+};
+
+static int context_char(const char chr)
+{
+	return chr && chr != '"' && chr != '\\' && chr != '\n';
+}
+
+/* contexts are checked with the suffix index if there is one and the window is larger */
+#define ANCHOR_SCAN_WINDOW 4096
+
+static int unique_in_index(struct suffix_index *index, const char *text, const size_t window,
+			   const size_t start, const size_t len)
+{
+	size_t first;
+
+	return suffix_index_next(index, text + start, len, window, &first) == 0 && first == start;
+}
+
+/* the length of the shortest string at start that does not occur in [window, start) */
+static size_t unique_length(struct telex_doc *doc, const size_t window, const size_t start)
+{
+	const char *text;
+	const char *cur;
+	size_t need;
+	size_t max;
+
+	text = doc->start;
+
+	for (max = 0; max < ANCHOR_MAX_CONTEXT && start + max < doc->size &&
+		     context_char(text[start + max]); max++);
+
+	if (!max) {
+		return 0;
+	}
+
+	if (doc->suffix_index && start - window > ANCHOR_SCAN_WINDOW) {
+		size_t lo;
+		size_t hi;
+
+		if (!unique_in_index(doc->suffix_index, text, window, start, max)) {
+			return 0;
+		}
+
+		/* strings that are longer than a unique one are unique, too */
+		for (lo = 0, hi = max; hi - lo > 1; ) {
+			size_t mid;
+
+			mid = lo + (hi - lo) / 2;
+
+			if (unique_in_index(doc->suffix_index, text, window, start, mid)) {
+				hi = mid;
+			} else {
+				lo = mid;
+			}
+		}
+
+		return hi;
+	}
+
+	need = 1;
+
+	for (cur = text + window; (cur = memchr(cur, text[start], text + start - cur)); cur++) {
+		size_t common;
+
+		for (common = 1; common < max && cur[common] == text[start + common]; common++);
+
+		if (common == max) {
+			return 0;
+		}
+
+		if (common >= need) {
+			need = common + 1;
+		}
+	}
+
+	return need;
+}
+
+static void try_context(struct telex_doc *doc, const size_t window, const size_t start,
+			struct context *best)
+{
+	size_t len;
+
+	if ((len = unique_length(doc, window, start)) &&
+	    (!best->len || len < best->len)) {
+		best->start = start;
+		best->len = len;
+	}
+}
+
+/* appends a step to steps, consuming expr */
+static int add_step(struct compound_expr **steps, const token_type_t prefix,
+		    struct or_expr *expr)
+{
+	struct compound_expr *step;
+	struct token *token;
+
+	token = NULL;
+
+	if (!expr ||
+	    (prefix != TOKEN_INVALID &&
+	     !(token = token_new(prefix, prefix == TOKEN_LESS ? "<" : ">", 1, -1, -1))) ||
+	    !(step = compound_expr_new(*steps, token, expr))) {
+		token_free(&token);
+		or_expr_free(&expr);
+		return -ENOMEM;
+	}
+
+	*steps = step;
+	return 0;
+}
+
+/* ":line>\"context\"", followed by ">:lines" if lines is not zero, and by a column move */
+static int context_telex(struct telex **telex, const char *text, const size_t line,
+			 const struct context *context, const size_t lines, const long col)
+{
+	struct compound_expr *steps;
+	int err;
+
+	steps = NULL;
+
+	if ((err = add_step(&steps, TOKEN_INVALID, position_or_expr(TOKEN_COLON, line))) < 0 ||
+	    (err = add_step(&steps, TOKEN_GREATER,
+			    string_or_expr(text + context->start, context->len))) < 0 ||
+	    (lines && (err = add_step(&steps, TOKEN_GREATER,
+				      position_or_expr(TOKEN_COLON, lines))) < 0) ||
+	    (col && (err = add_step(&steps, col < 0 ? TOKEN_LESS : TOKEN_GREATER,
+				    position_or_expr(TOKEN_POUND, col < 0 ? -col : col))) < 0)) {
+		goto cleanup;
+	}
+
+	if (!(*telex = telex_new(NULL, steps))) {
+		err = -ENOMEM;
+		goto cleanup;
+	}
+
+	return 0;
+
+cleanup:
+	compound_expr_free(&steps);
+	return err;
+}
+
+int telex_anchor_generate(struct telex **telex, struct telex_doc *doc, const char *pos,
+			  const size_t slack)
+{
+	struct context best;
+	size_t line_start;
+	size_t line_end;
+	size_t anchor;
+	size_t window;
+	size_t offset;
+	size_t shift;
+	size_t line;
+	size_t col;
+	size_t l;
+	int err;
+
+	if (!telex || !doc || !pos || pos < doc->start || pos > doc->start + doc->size) {
+		return -EINVAL;
+	}
+
+	offset = pos - doc->start;
+
+	if ((err = line_index_position(doc->line_index, doc->start, doc->size,
+				       offset, &line, &col)) < 0) {
+		return err;
+	}
+
+	line_start = offset - col;
+	anchor = line > slack ? line - slack : 1;
+	window = 0;
+
+	/* the window starts after the newline that ends the line above the anchor line */
+	if (anchor > 1) {
+		window = search_rnewline(doc->start, 0, line_start, slack + 1) - doc->start + 1;
+	}
+	line_end = doc->size - offset > ANCHOR_MAX_SHIFT ? offset + ANCHOR_MAX_SHIFT : doc->size;
+
+	if ((pos = memchr(pos, '\n', line_end - offset))) {
+		line_end = pos - doc->start;
+	}
+
+	/* the shortest string in the line of pos, as close to pos as possible */
+	best.len = 0;
+
+	for (shift = 0; shift <= ANCHOR_MAX_SHIFT && (!best.len || shift < best.len); shift++) {
+		if (offset - line_start >= shift) {
+			try_context(doc, window, offset - shift, &best);
+		}
+
+		if (shift && offset + shift < line_end) {
+			try_context(doc, window, offset + shift, &best);
+		}
+	}
+
+	if (best.len) {
+		return context_telex(telex, doc->start, anchor, &best, 0,
+				     (long)offset - (long)best.start);
+	}
+
+	/* otherwise, the end of one of the lines above, followed by a line and column move */
+	for (l = line - 1, line_end = line_start; l >= anchor && line_end > window; l--) {
+		const char *newline;
+		size_t start;
+
+		line_end--;
+		newline = memrchr(doc->start + window, '\n', line_end - window);
+		line_start = newline ? (size_t)(newline - doc->start) + 1 : window;
+
+		for (start = line_end; start > line_start && line_end - start < ANCHOR_MAX_SHIFT; ) {
+			try_context(doc, window, --start, &best);
+		}
+
+		if (best.len) {
+			return context_telex(telex, doc->start, anchor, &best, line - l, col);
+		}
+
+		line_end = line_start;
+	}
+
+	return position_telex(telex, line, col);
+}
@@ -0,0 +1,307 @@
+/*
+ * batch.c - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <telex/batch.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "telex.h"
+#include "eval.h"
+#include "stats.h"
+
+/*
+ * Every worker owns a range of documents. It takes documents from the
+ * front of its own range, and when that is empty, it steals the back half
+ * of another worker's range. Telexes are only read during evaluation, so
+ * all workers share them.
+ */
+
+struct batch;
+
+struct batch_worker {
+	struct batch *batch;
+	pthread_t thread;
+	int index;
+
+	pthread_mutex_t lock;
+	size_t next;
+	size_t end;
+
+	/* documents that are read from files are read into this buffer */
+	char *buffer;
+	size_t buffer_size;
+};
+
+struct batch {
+	struct telex **telexes;
+	int num_telexes;
+	const struct telex_batch_doc *docs;
+	struct telex_batch_result *results;
+
+	struct batch_worker *workers;
+	int num_workers;
+};
+
+static int worker_take(struct batch_worker *worker, size_t *doc)
+{
+	int taken;
+
+	pthread_mutex_lock(&worker->lock);
+
+	if ((taken = worker->next < worker->end)) {
+		*doc = worker->next++;
+	}
+
+	pthread_mutex_unlock(&worker->lock);
+	return taken;
+}
+
+static int worker_steal(struct batch_worker *worker, size_t *doc)
+{
+	struct batch *batch;
+	int i;
+
+	batch = worker->batch;
+
+	for (i = 1; i < batch->num_workers; i++) {
+		struct batch_worker *victim;
+		size_t first;
+		size_t end;
+
+		victim = &batch->workers[(worker->index + i) % batch->num_workers];
+
+		pthread_mutex_lock(&victim->lock);
+
+		end = victim->end;
+		first = victim->next + (victim->end - victim->next) / 2;
+		victim->end = first;
+
+		pthread_mutex_unlock(&victim->lock);
+
+		if (first == end) {
+			continue;
+		}
+
+		pthread_mutex_lock(&worker->lock);
+		worker->next = first + 1;
+		worker->end = end;
+		pthread_mutex_unlock(&worker->lock);
+
+		*doc = first;
+		return 1;
+	}
+
+	return 0;
+}
+
+static int read_file(struct batch_worker *worker, const char *path, size_t *size)
+{
+	struct stat info;
+	size_t length;
+	int err;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) < 0) {
+		return -errno;
+	}
+
+	if (fstat(fd, &info) < 0) {
+		err = -errno;
+		goto cleanup;
+	}
+
+	if ((size_t)info.st_size + 1 > worker->buffer_size) {
+		char *buffer;
+
+		if (!(buffer = realloc(worker->buffer, info.st_size + 1))) {
+			err = -ENOMEM;
+			goto cleanup;
+		}
+
+		worker->buffer = buffer;
+		worker->buffer_size = info.st_size + 1;
+	}
+
+	for (length = 0; length < (size_t)info.st_size; ) {
+		ssize_t n;
+
+		if ((n = read(fd, worker->buffer + length, info.st_size - length)) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			err = -errno;
+			goto cleanup;
+		}
+
+		if (!n) {
+			break;
+		}
+
+		length += n;
+	}
+
+	/* lookups expect the text to be terminated */
+	worker->buffer[length] = 0;
+	*size = length;
+	err = 0;
+
+cleanup:
+	close(fd);
+	return err;
+}
+
+static void worker_process(struct batch_worker *worker, const size_t index)
+{
+	const struct telex_batch_doc *doc;
+	struct telex_batch_result *results;
+	struct telex_stats scratch;
+	struct eval_context ctx;
+	struct batch *batch;
+	const char *start;
+	size_t size;
+	int err;
+	int i;
+
+	batch = worker->batch;
+	doc = &batch->docs[index];
+	results = &batch->results[index * batch->num_telexes];
+	start = doc->start;
+	size = doc->size;
+	err = 0;
+
+	if (doc->path) {
+		err = read_file(worker, doc->path, &size);
+		start = worker->buffer;
+	} else if (!doc->start) {
+		err = -EINVAL;
+	}
+
+	if (err < 0) {
+		for (i = 0; i < batch->num_telexes; i++) {
+			results[i].error = err;
+			results[i].offset = 0;
+		}
+
+		return;
+	}
+
+	eval_context_init(&ctx, start, size, NULL);
+
+	for (i = 0; i < batch->num_telexes; i++) {
+		const char *result;
+		token_type_t prefix;
+
+		prefix = batch->telexes[i]->prefix ? batch->telexes[i]->prefix->type : TOKEN_INVALID;
+		result = NULL;
+
+		/* every telex is a lookup of its own, from the start of the document */
+		stats_start(&ctx, NULL, &scratch);
+		results[i].error = eval_telex(batch->telexes[i], &ctx, start, prefix, &result);
+		stats_finish(&ctx);
+		results[i].offset = results[i].error < 0 ? 0 : (size_t)(result - start);
+	}
+}
+
+static void* worker_main(void *data)
+{
+	struct batch_worker *worker;
+	size_t doc;
+
+	worker = (struct batch_worker*)data;
+
+	while (worker_take(worker, &doc) || worker_steal(worker, &doc)) {
+		worker_process(worker, doc);
+	}
+
+	return NULL;
+}
+
+int telex_batch_lookup(struct telex **telexes, const int num_telexes,
+		       const struct telex_batch_doc *docs, const size_t num_docs,
+		       struct telex_batch_result *results, const int num_threads)
+{
+	struct batch batch;
+	int num_started;
+	int i;
+
+	if (!telexes || num_telexes < 0 || (!docs && num_docs) || (!results && num_docs) ||
+	    num_threads < 1) {
+		return -EINVAL;
+	}
+
+	for (i = 0; i < num_telexes; i++) {
+		if (!telexes[i]) {
+			return -EINVAL;
+		}
+	}
+
+	batch.telexes = telexes;
+	batch.num_telexes = num_telexes;
+	batch.docs = docs;
+	batch.results = results;
+	batch.num_workers = num_threads;
+
+	if (!(batch.workers = calloc(num_threads, sizeof(*batch.workers)))) {
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < num_threads; i++) {
+		struct batch_worker *worker;
+
+		worker = &batch.workers[i];
+		worker->batch = &batch;
+		worker->index = i;
+		worker->next = num_docs * i / num_threads;
+		worker->end = num_docs * (i + 1) / num_threads;
+		pthread_mutex_init(&worker->lock, NULL);
+	}
+
+	/*
+	 * The calling thread is the first worker. If not all threads can be
+	 * started, the others steal the documents of the missing ones.
+	 */
+	for (num_started = 1; num_started < num_threads; num_started++) {
+		struct batch_worker *worker;
+
+		worker = &batch.workers[num_started];
+
+		if (pthread_create(&worker->thread, NULL, worker_main, worker) != 0) {
+			break;
+		}
+	}
+
+	worker_main(&batch.workers[0]);
+
+	for (i = 1; i < num_started; i++) {
+		pthread_join(batch.workers[i].thread, NULL);
+	}
+
+	for (i = 0; i < num_threads; i++) {
+		pthread_mutex_destroy(&batch.workers[i].lock);
+		free(batch.workers[i].buffer);
+	}
+
+	free(batch.workers);
+	return 0;
+}
@@ -0,0 +1,482 @@
+/*
+ * cache.c - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "cache.h"
+#include "telex.h"
+#include "eval.h"
+
+/*
+ * For every lookup, the cache remembers the position after each step of
+ * the telex and the part of the text that the step's result depends on.
+ * When the text is edited, steps that depend on the edited range are
+ * invalidated, together with all steps after them. The results of the
+ * remaining steps are shifted by the length difference of the edit, and
+ * the next lookup continues evaluation at the first invalid step.
+ *
+ * The lock only protects finding entries and publishing their results.
+ * Steps are evaluated without it, so that lookups that miss the cache
+ * don't wait for each other, and entries that are evicted while they are
+ * being evaluated are freed by their last user.
+ */
+
+struct cache_step {
+	size_t result;
+	size_t scan_first;
+	size_t scan_last;
+};
+
+struct cache_entry {
+	struct cache_entry *next;
+	struct cache_entry *older;
+	struct cache_entry *newer;
+
+	uint64_t hash;
+	uint64_t telex_hash;
+	struct telex *telex;
+	int has_pos;
+	size_t pos;
+
+	struct compound_expr **steps;
+	struct cache_step *results;
+	int num_steps;
+	int valid_steps;
+	int error;
+
+	int users;
+	int removed;
+};
+
+struct lookup_cache {
+	pthread_mutex_t lock;
+
+	struct cache_entry **buckets;
+	size_t num_buckets;
+	size_t num_entries;
+	size_t max_entries;
+
+	struct cache_entry *newest;
+	struct cache_entry *oldest;
+};
+
+static uint64_t cache_key(const uint64_t telex_hash, const int has_pos, const size_t pos)
+{
+	uint64_t key;
+
+	key = telex_hash ^ ((uint64_t)pos * 0x9e3779b97f4a7c15ULL);
+	return has_pos ? key : ~key;
+}
+
+static void cache_entry_free(struct cache_entry **entry)
+{
+	if (entry && *entry) {
+		telex_free(&(*entry)->telex);
+		free((*entry)->steps);
+		free((*entry)->results);
+		free(*entry);
+		*entry = NULL;
+	}
+}
+
+static int cache_entry_new(struct cache_entry **entry, struct telex *telex,
+			   const uint64_t telex_hash, const int has_pos, const size_t pos)
+{
+	struct cache_entry *new;
+	int num_steps;
+
+	if (!(new = calloc(1, sizeof(*new)))) {
+		return -ENOMEM;
+	}
+
+	new->hash = cache_key(telex_hash, has_pos, pos);
+	new->telex_hash = telex_hash;
+	new->has_pos = has_pos;
+	new->pos = pos;
+
+	if (!(new->telex = telex_clone(telex))) {
+		cache_entry_free(&new);
+		return -ENOMEM;
+	}
+
+	if ((num_steps = compound_expr_flatten(new->telex->compound_expr, &new->steps)) < 0) {
+		cache_entry_free(&new);
+		return num_steps;
+	}
+
+	new->num_steps = num_steps;
+
+	if (!(new->results = calloc(num_steps, sizeof(*new->results)))) {
+		cache_entry_free(&new);
+		return -ENOMEM;
+	}
+
+	*entry = new;
+	return 0;
+}
+
+int lookup_cache_new(struct lookup_cache **cache, const size_t max_entries)
+{
+	struct lookup_cache *new;
+
+	if (!cache || !max_entries) {
+		return -EINVAL;
+	}
+
+	if (!(new = calloc(1, sizeof(*new)))) {
+		return -ENOMEM;
+	}
+
+	for (new->num_buckets = 16; new->num_buckets < max_entries; new->num_buckets <<= 1);
+	new->max_entries = max_entries;
+
+	if (!(new->buckets = calloc(new->num_buckets, sizeof(*new->buckets)))) {
+		free(new);
+		return -ENOMEM;
+	}
+
+	pthread_mutex_init(&new->lock, NULL);
+	*cache = new;
+	return 0;
+}
+
+void lookup_cache_free(struct lookup_cache **cache)
+{
+	if (cache && *cache) {
+		while ((*cache)->newest) {
+			struct cache_entry *entry;
+
+			entry = (*cache)->newest;
+			(*cache)->newest = entry->older;
+			cache_entry_free(&entry);
+		}
+
+		pthread_mutex_destroy(&(*cache)->lock);
+		free((*cache)->buckets);
+		free(*cache);
+		*cache = NULL;
+	}
+}
+
+static void cache_unlink_age(struct lookup_cache *cache, struct cache_entry *entry)
+{
+	if (entry->newer) {
+		entry->newer->older = entry->older;
+	} else {
+		cache->newest = entry->older;
+	}
+
+	if (entry->older) {
+		entry->older->newer = entry->newer;
+	} else {
+		cache->oldest = entry->newer;
+	}
+
+	entry->newer = NULL;
+	entry->older = NULL;
+}
+
+static void cache_link_age(struct lookup_cache *cache, struct cache_entry *entry)
+{
+	entry->older = cache->newest;
+	entry->newer = NULL;
+
+	if (cache->newest) {
+		cache->newest->newer = entry;
+	} else {
+		cache->oldest = entry;
+	}
+
+	cache->newest = entry;
+}
+
+static void cache_remove(struct lookup_cache *cache, struct cache_entry *entry)
+{
+	struct cache_entry **link;
+
+	for (link = &cache->buckets[entry->hash & (cache->num_buckets - 1)];
+	     *link && *link != entry;
+	     link = &(*link)->next);
+
+	if (*link) {
+		*link = entry->next;
+	}
+
+	cache_unlink_age(cache, entry);
+	cache->num_entries--;
+	entry->removed = 1;
+
+	if (!entry->users) {
+		cache_entry_free(&entry);
+	}
+}
+
+static void cache_entry_put(struct cache_entry *entry)
+{
+	if (!--entry->users && entry->removed) {
+		cache_entry_free(&entry);
+	}
+}
+
+static void cache_insert(struct lookup_cache *cache, struct cache_entry *entry)
+{
+	struct cache_entry **bucket;
+
+	if (cache->num_entries >= cache->max_entries) {
+		cache_remove(cache, cache->oldest);
+	}
+
+	bucket = &cache->buckets[entry->hash & (cache->num_buckets - 1)];
+	entry->next = *bucket;
+	*bucket = entry;
+
+	cache_link_age(cache, entry);
+	cache->num_entries++;
+}
+
+static struct cache_entry* cache_find(struct lookup_cache *cache, struct telex *telex,
+				      const uint64_t hash, const int has_pos, const size_t pos)
+{
+	struct cache_entry *entry;
+
+	for (entry = cache->buckets[hash & (cache->num_buckets - 1)]; entry; entry = entry->next) {
+		if (entry->hash == hash && entry->has_pos == has_pos && entry->pos == pos &&
+		    telex_equal(entry->telex, telex)) {
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+/* returns the entry for the lookup, with the lock held */
+static int cache_get(struct lookup_cache *cache, struct telex *telex, const uint64_t telex_key,
+		     const int has_pos, const size_t pos, struct cache_entry **entry)
+{
+	struct cache_entry *new;
+	uint64_t hash;
+	int err;
+
+	hash = cache_key(telex_key, has_pos, pos);
+	pthread_mutex_lock(&cache->lock);
+
+	if (!(*entry = cache_find(cache, telex, hash, has_pos, pos))) {
+		/* cloning the telex is slow, and another thread may add the entry meanwhile */
+		pthread_mutex_unlock(&cache->lock);
+
+		if ((err = cache_entry_new(&new, telex, telex_key, has_pos, pos)) < 0) {
+			return err;
+		}
+
+		pthread_mutex_lock(&cache->lock);
+
+		if ((*entry = cache_find(cache, telex, hash, has_pos, pos))) {
+			cache_entry_free(&new);
+		} else {
+			cache_insert(cache, new);
+			*entry = new;
+		}
+	}
+
+	cache_unlink_age(cache, *entry);
+	cache_link_age(cache, *entry);
+
+	return 0;
+}
+
+int lookup_cache_eval(struct lookup_cache *cache, struct telex *telex,
+		      struct eval_context *ctx, const char *pos, const char **result)
+{
+	struct cache_step *results;
+	struct cache_entry *entry;
+	token_type_t prefix;
+	const char *cur;
+	size_t offset;
+	int first;
+	int err;
+	int i;
+
+	if (!cache || !telex || !ctx || !result) {
+		return -EINVAL;
+	}
+
+	if (telex->prefix && !pos) {
+		return -EBADMSG;
+	}
+
+	offset = pos ? (size_t)(pos - ctx->start) : 0;
+
+	if ((err = cache_get(cache, telex, telex_hash(telex), pos != NULL, offset, &entry)) < 0) {
+		return err;
+	}
+
+	first = entry->valid_steps;
+	cur = first > 0 ? ctx->start + entry->results[first - 1].result : ctx->start + offset;
+
+	if (entry->error || first == entry->num_steps) {
+		err = entry->error;
+		pthread_mutex_unlock(&cache->lock);
+
+		if (!err) {
+			*result = cur;
+		}
+
+		return err;
+	}
+
+	/* the steps of an entry never change, so they can be evaluated without the lock */
+	entry->users++;
+	pthread_mutex_unlock(&cache->lock);
+	i = first;
+
+	if (!(results = malloc((entry->num_steps - first) * sizeof(*results)))) {
+		err = -ENOMEM;
+		goto cleanup;
+	}
+
+	prefix = telex->prefix ? telex->prefix->type : TOKEN_INVALID;
+
+	for (i = first; i < entry->num_steps; i++) {
+		struct cache_step *step;
+		const char *origin;
+
+		step = &results[i - first];
+		origin = cur;
+		ctx->scan_first = origin;
+		ctx->scan_last = origin;
+
+		err = eval_compound_step(entry->steps[i], ctx, origin, prefix, &cur);
+
+		if (err < 0) {
+			cur = origin;
+		} else if (cur < ctx->scan_first) {
+			ctx->scan_first = cur;
+		} else if (cur > ctx->scan_last) {
+			ctx->scan_last = cur;
+		}
+
+		step->result = cur - ctx->start;
+		step->scan_first = ctx->scan_first - ctx->start;
+		step->scan_last = ctx->scan_last - ctx->start;
+
+		if (err < 0) {
+			i++;
+			break;
+		}
+	}
+
+cleanup:
+	pthread_mutex_lock(&cache->lock);
+
+	/* unless another lookup published the same steps first */
+	if (results && entry->valid_steps == first && !entry->error) {
+		memcpy(entry->results + first, results, (i - first) * sizeof(*results));
+		entry->valid_steps = i;
+		entry->error = err < 0 ? err : 0;
+	}
+
+	cache_entry_put(entry);
+	pthread_mutex_unlock(&cache->lock);
+	free(results);
+
+	if (err < 0) {
+		return err;
+	}
+
+	*result = cur;
+	return 0;
+}
+
+static size_t shift(const size_t value, const size_t edit_end, const size_t removed_len,
+		    const size_t inserted_len)
+{
+	return value > edit_end ? value - removed_len + inserted_len : value;
+}
+
+void lookup_cache_edit(struct lookup_cache *cache, const size_t offset,
+		       const size_t removed_len, const size_t inserted_len)
+{
+	struct cache_entry *entry;
+	struct cache_entry *older;
+	size_t edit_end;
+
+	if (!cache) {
+		return;
+	}
+
+	pthread_mutex_lock(&cache->lock);
+	edit_end = offset + removed_len;
+
+	for (entry = cache->newest; entry; entry = older) {
+		int i;
+
+		older = entry->older;
+
+		if (entry->has_pos) {
+			if (entry->pos >= offset && entry->pos <= edit_end) {
+				/* the position the lookup started at has been edited */
+				cache_remove(cache, entry);
+				continue;
+			}
+
+			entry->pos = shift(entry->pos, edit_end, removed_len, inserted_len);
+		}
+
+		for (i = 0; i < entry->valid_steps; i++) {
+			struct cache_step *step;
+
+			step = &entry->results[i];
+
+			if (step->scan_first <= edit_end && step->scan_last >= offset) {
+				break;
+			}
+
+			step->result = shift(step->result, edit_end, removed_len, inserted_len);
+			step->scan_first = shift(step->scan_first, edit_end, removed_len, inserted_len);
+			step->scan_last = shift(step->scan_last, edit_end, removed_len, inserted_len);
+		}
+
+		if (i < entry->valid_steps) {
+			entry->valid_steps = i;
+			entry->error = 0;
+		}
+	}
+
+	/* the keys contain the start positions, so everything has to be rehashed */
+	for (entry = cache->newest; entry; entry = entry->older) {
+		entry->next = NULL;
+	}
+
+	memset(cache->buckets, 0, cache->num_buckets * sizeof(*cache->buckets));
+
+	for (entry = cache->oldest; entry; entry = entry->newer) {
+		struct cache_entry **bucket;
+
+		entry->hash = cache_key(entry->telex_hash, entry->has_pos, entry->pos);
+		bucket = &cache->buckets[entry->hash & (cache->num_buckets - 1)];
+		entry->next = *bucket;
+		*bucket = entry;
+	}
+
+	pthread_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,38 @@
+/*
+ * cache.h - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include "telex.h"
+
+struct eval_context;
+struct lookup_cache;
+
+int lookup_cache_new(struct lookup_cache **cache, const size_t max_entries);
+void lookup_cache_free(struct lookup_cache **cache);
+
+int lookup_cache_eval(struct lookup_cache *cache, struct telex *telex,
+		      struct eval_context *ctx, const char *pos, const char **result);
+void lookup_cache_edit(struct lookup_cache *cache, const size_t offset,
+		       const size_t removed_len, const size_t inserted_len);
+
+#endif /* CACHE_H */
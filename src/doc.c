@@ -0,0 +1,377 @@
+/*
+ * doc.c - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <telex/doc.h>
+#include <telex/telex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include "doc.h"
+#include "eval.h"
+#include "stats.h"
+#include "trace.h"
+#include "suffix.h"
+#include "trigram.h"
+#include "cache.h"
+#include "parallel.h"
+#include "lines.h"
+#include "telex.h"
+
+int telex_doc_new(struct telex_doc **doc, const char *start, const size_t size)
+{
+	struct telex_doc *new;
+
+	if (!doc || !start) {
+		return -EINVAL;
+	}
+
+	if (!(new = calloc(1, sizeof(*new)))) {
+		return -ENOMEM;
+	}
+
+	new->start = start;
+	new->size = size;
+
+	*doc = new;
+	return 0;
+}
+
+void telex_doc_free(struct telex_doc **doc)
+{
+	if (doc && *doc) {
+		telex_doc_drop_index(*doc);
+		telex_doc_drop_trigrams(*doc);
+		telex_doc_drop_lines(*doc);
+		lookup_cache_free(&(*doc)->cache);
+		parallel_pool_free(&(*doc)->parallel_pool);
+		free(*doc);
+		*doc = NULL;
+	}
+}
+
+int telex_doc_build_index(struct telex_doc *doc)
+{
+	struct suffix_index *index;
+	int err;
+
+	if (!doc) {
+		return -EINVAL;
+	}
+
+	if (doc->suffix_index) {
+		return -EALREADY;
+	}
+
+	if ((err = suffix_index_build(&index, doc->start, doc->size)) < 0) {
+		return err;
+	}
+
+	doc->suffix_index = index;
+	return 0;
+}
+
+int telex_doc_save_index(struct telex_doc *doc, const char *path)
+{
+	FILE *file;
+	int err;
+
+	if (!doc || !path) {
+		return -EINVAL;
+	}
+
+	if (!doc->suffix_index) {
+		return -ENOENT;
+	}
+
+	if (!(file = fopen(path, "wb"))) {
+		return -errno;
+	}
+
+	err = suffix_index_save(doc->suffix_index, file);
+
+	if (fclose(file) && !err) {
+		err = -EIO;
+	}
+
+	return err;
+}
+
+int telex_doc_load_index(struct telex_doc *doc, const char *path)
+{
+	struct suffix_index *index;
+	FILE *file;
+	int err;
+
+	if (!doc || !path) {
+		return -EINVAL;
+	}
+
+	if (doc->suffix_index) {
+		return -EALREADY;
+	}
+
+	if (!(file = fopen(path, "rb"))) {
+		return -errno;
+	}
+
+	err = suffix_index_load(&index, file, doc->start, doc->size);
+	fclose(file);
+
+	if (!err) {
+		doc->suffix_index = index;
+	}
+
+	return err;
+}
+
+void telex_doc_drop_index(struct telex_doc *doc)
+{
+	if (doc) {
+		suffix_index_free(&doc->suffix_index);
+	}
+}
+
+int telex_doc_spill_trigrams(struct telex_doc *doc, const char *path, const size_t memory_limit)
+{
+	if (!doc || !path || !memory_limit) {
+		return -EINVAL;
+	}
+
+	if (doc->trigram_index) {
+		return -EALREADY;
+	}
+
+	return trigram_index_new(&doc->trigram_index, memory_limit, path);
+}
+
+int telex_doc_build_trigrams(struct telex_doc *doc, const size_t max_bytes)
+{
+	int err;
+
+	if (!doc) {
+		return -EINVAL;
+	}
+
+	if (!doc->trigram_index &&
+	    (err = trigram_index_new(&doc->trigram_index, 0, NULL)) < 0) {
+		return err;
+	}
+
+	return trigram_index_update(doc->trigram_index, doc->start, doc->size, max_bytes);
+}
+
+void telex_doc_drop_trigrams(struct telex_doc *doc)
+{
+	if (doc) {
+		trigram_index_free(&doc->trigram_index);
+	}
+}
+
+int telex_doc_build_lines(struct telex_doc *doc, const size_t interval)
+{
+	if (!doc) {
+		return -EINVAL;
+	}
+
+	line_index_free(&doc->line_index);
+
+	return line_index_new(&doc->line_index, doc->start, doc->size, interval);
+}
+
+void telex_doc_drop_lines(struct telex_doc *doc)
+{
+	if (doc) {
+		line_index_free(&doc->line_index);
+	}
+}
+
+int telex_doc_parallel(struct telex_doc *doc, const int num_threads, const size_t chunk_size)
+{
+	if (!doc || num_threads < 0) {
+		return -EINVAL;
+	}
+
+	parallel_pool_free(&doc->parallel_pool);
+
+	/* a single thread searches sequentially */
+	return num_threads > 1 ?
+		parallel_pool_new(&doc->parallel_pool, num_threads, chunk_size) : 0;
+}
+
+int telex_doc_cache(struct telex_doc *doc, const size_t max_entries)
+{
+	if (!doc) {
+		return -EINVAL;
+	}
+
+	lookup_cache_free(&doc->cache);
+
+	return max_entries ? lookup_cache_new(&doc->cache, max_entries) : 0;
+}
+
+int telex_doc_edit(struct telex_doc *doc, const char *start, const size_t size,
+		   const size_t offset, const size_t removed_len, const size_t inserted_len)
+{
+	if (!doc || !start ||
+	    offset > doc->size || removed_len > doc->size - offset ||
+	    size != doc->size - removed_len + inserted_len) {
+		return -EINVAL;
+	}
+
+	/*
+	 * The suffix index has to be rebuilt after any change, but the trigram
+	 * index can simply continue where it left off if text was appended. The
+	 * line index only has to be redone from the change on.
+	 */
+	telex_doc_drop_index(doc);
+
+	if (offset != doc->size || removed_len) {
+		telex_doc_drop_trigrams(doc);
+	}
+
+	if (doc->line_index && line_index_edit(doc->line_index, start, size, offset) < 0) {
+		telex_doc_drop_lines(doc);
+	}
+
+	lookup_cache_edit(doc->cache, offset, removed_len, inserted_len);
+
+	doc->start = start;
+	doc->size = size;
+
+	return 0;
+}
+
+const char* telex_doc_lookup(struct telex_doc *doc, struct telex *telex, const char *pos)
+{
+	struct telex_stats scratch;
+	struct eval_context ctx;
+	const char *result;
+	token_type_t prefix;
+	int err;
+
+	if (!doc || !telex) {
+		return NULL;
+	}
+
+	eval_context_init(&ctx, doc->start, doc->size, doc);
+	stats_start(&ctx, NULL, &scratch);
+	result = NULL;
+
+	if (doc->cache) {
+		/* the cache is the only part of a document that lookups modify, and it locks itself */
+		err = lookup_cache_eval(doc->cache, telex, &ctx, pos, &result);
+	} else {
+		prefix = telex->prefix ? telex->prefix->type : TOKEN_INVALID;
+		err = eval_telex(telex, &ctx, pos, prefix, &result);
+	}
+
+	stats_finish(&ctx);
+
+	if (err < 0) {
+		result = NULL;
+	}
+
+	if (trace_active()) {
+		trace_lookup(telex, doc->start, doc->size, pos, result);
+	}
+
+	return result;
+}
+
+int telex_doc_lookup_range(struct telex_doc *doc, struct telex_range *range, const char *pos,
+			   struct telex_span *span)
+{
+	struct telex_stats scratch;
+	struct eval_context ctx;
+	const char *begin;
+	token_type_t prefix;
+	int err;
+
+	if (!doc || !range || !range->start || !span) {
+		return -EINVAL;
+	}
+
+	eval_context_init(&ctx, doc->start, doc->size, doc);
+	stats_start(&ctx, NULL, &scratch);
+	begin = NULL;
+
+	/* only the start is cached; the end is looked for from wherever the start leads */
+	if (doc->cache) {
+		err = lookup_cache_eval(doc->cache, range->start, &ctx, pos, &begin);
+	} else {
+		prefix = range->start->prefix ? range->start->prefix->type : TOKEN_INVALID;
+		err = eval_telex(range->start, &ctx, pos, prefix, &begin);
+	}
+
+	if (err >= 0) {
+		err = eval_range_end(range, &ctx, begin, span);
+	}
+
+	stats_finish(&ctx);
+
+	if (err < 0) {
+		span->begin = NULL;
+		span->end = NULL;
+	}
+
+	if (trace_active()) {
+		trace_lookup_range(range, doc->start, doc->size, pos, err, span);
+	}
+
+	return err;
+}
+
+int telex_doc_rlookup(struct telex_doc *doc, struct telex **telex, const char *pos)
+{
+	size_t line;
+	size_t col;
+	int err;
+
+	if (!doc || !telex || !pos || pos < doc->start) {
+		return -EINVAL;
+	}
+
+	if ((err = line_index_position(doc->line_index, doc->start, doc->size,
+				       pos - doc->start, &line, &col)) < 0) {
+		return err;
+	}
+
+	return position_telex(telex, line, col);
+}
+
+int telex_doc_offset_to_position(struct telex_doc *doc, const size_t offset,
+				 size_t *line, size_t *col)
+{
+	if (!doc) {
+		return -EINVAL;
+	}
+
+	return line_index_position(doc->line_index, doc->start, doc->size, offset, line, col);
+}
+
+int telex_doc_position_to_offset(struct telex_doc *doc, const size_t line, const size_t col,
+				 size_t *offset)
+{
+	if (!doc) {
+		return -EINVAL;
+	}
+
+	return line_index_offset(doc->line_index, doc->start, doc->size, line, col, offset);
+}
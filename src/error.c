@@ -28,6 +28,7 @@ struct telex_error* telex_error_new(int line, int col, const char *fmt, ...)
 {
 	struct telex_error *error;
 	va_list args;
+	va_list copy;
 	int required_length;
 
 	if (!(error = calloc(1, sizeof(*error)))) {
@@ -40,12 +41,15 @@ struct telex_error* telex_error_new(int line, int col, const char *fmt, ...)
 
 	va_start(args, fmt);
 
+	/* the first vsnprintf() consumes args */
+	va_copy(copy, args);
 	required_length = vsnprintf(NULL, 0, fmt,  args);
 
 	if ((error->message = malloc(required_length + 1))) {
-		vsnprintf(error->message, required_length + 1, fmt, args);
+		vsnprintf(error->message, required_length + 1, fmt, copy);
 	}
 
+	va_end(copy);
 	va_end(args);
 
 	if (!error->message) {
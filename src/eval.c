@@ -1,288 +1,646 @@
+#define _GNU_SOURCE
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <errno.h>
+#include <time.h>
 #include "telex.h"
+#include "eval.h"
+#include "doc.h"
+#include "suffix.h"
+#include "trigram.h"
+#include "parallel.h"
+#include "search.h"
+#include "primitive.h"
+#include "stats.h"
+#include "probes.h"
+
+/* how often limited lookups look at the clock, and how much they search at once */
+#define EVAL_CHECK_INTERVAL (64 * 1024)
+
+void eval_context_init(struct eval_context *ctx, const char *start, const size_t size,
+		       struct telex_doc *doc)
+{
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->start = start;
+	ctx->size = size;
+	ctx->doc = doc;
+}
+
+static void eval_scanned(struct eval_context *ctx, const char *first, const char *last)
+{
+	if (first > last) {
+		const char *swap;
 
-int eval_telex(struct telex *telex, const char *start, const size_t size,
-               const char *pos, token_type_t prefix, const char **result);
+		swap = first;
+		first = last;
+		last = swap;
+	}
+
+	if (!ctx->scan_first || first < ctx->scan_first) {
+		ctx->scan_first = first;
+	}
 
-static const char* rstrstr(const char *haystack, const char *pos, const char *needle, const size_t len)
+	if (!ctx->scan_last || last > ctx->scan_last) {
+		ctx->scan_last = last;
+	}
+}
+
+/* movements depend on the text they crossed, and the character they stopped at */
+static void eval_moved(struct eval_context *ctx, const char *origin, const char *pos)
 {
-	/* FIXME: Write a faster implementation. This is the slowest possible one. */
+	const char *end;
+	const char *last;
 
-	while (pos >= haystack) {
-		if (strncmp(pos, needle, len) == 0) {
-			return pos + len;
-		}
+	end = ctx->start + ctx->size;
+	last = origin > pos ? origin : pos;
+
+	eval_scanned(ctx, origin < pos ? origin : pos, last < end ? last + 1 : end);
+}
+
+static void eval_span(struct eval_context *ctx, const char *begin, const char *end)
+{
+	if (begin > end) {
+		const char *swap;
 
-		pos--;
+		swap = begin;
+		begin = end;
+		end = swap;
 	}
 
-	return NULL;
+	ctx->span->begin = begin;
+	ctx->span->end = end;
 }
 
-int eval_string(struct token *string, const char *start, const size_t size,
-		const char *pos, token_type_t prefix, const char **result)
+/* the line that pos is on, without its newline */
+static void eval_span_line(struct eval_context *ctx, const char *pos)
 {
-	const char *new_pos;
+	const char *begin;
+	const char *end;
 
-	if (!string || !start || !pos || !result) {
-		return -EINVAL;
+	begin = memrchr(ctx->start, '\n', pos - ctx->start);
+	end = memchr(pos, '\n', ctx->start + ctx->size - pos);
+
+	eval_span(ctx, begin ? begin + 1 : ctx->start, end ? end : ctx->start + ctx->size);
+}
+
+static int deadline_passed(const struct telex_limits *limits)
+{
+	struct timespec now;
+
+	if (!limits->deadline.tv_sec && !limits->deadline.tv_nsec) {
+		return 0;
 	}
 
-	if (prefix == TOKEN_LESS || prefix == TOKEN_DLESS) {
-		new_pos = rstrstr(start, pos, string->lexeme, string->lexeme_len);
+	clock_gettime(CLOCK_MONOTONIC, &now);
 
-		if (new_pos && prefix == TOKEN_DLESS) {
-			new_pos -= string->lexeme_len;
-		}
-	} else {
-		new_pos = strstr(pos, string->lexeme);
+	return now.tv_sec > limits->deadline.tv_sec ||
+		(now.tv_sec == limits->deadline.tv_sec && now.tv_nsec >= limits->deadline.tv_nsec);
+}
 
-		if (new_pos && prefix == TOKEN_DGREATER) {
-			new_pos += string->lexeme_len;
-		}
+/* accounts for the work done by a lookup, and checks if it may continue */
+static int eval_charge(struct eval_context *ctx, const size_t bytes, const size_t lines)
+{
+	const struct telex_limits *limits;
+
+	if (!(limits = ctx->limits)) {
+		return 0;
 	}
 
-	if (!new_pos) {
-		return -ENOENT;
+	ctx->bytes_scanned += bytes;
+	ctx->lines_crossed += lines;
+
+	if (limits->max_bytes && ctx->bytes_scanned > limits->max_bytes) {
+		return -E2BIG;
+	}
+
+	if (limits->max_lines && ctx->lines_crossed > limits->max_lines) {
+		return -ERANGE;
+	}
+
+	if (limits->cancel && __atomic_load_n(limits->cancel, __ATOMIC_RELAXED)) {
+		return -ECANCELED;
+	}
+
+	if (ctx->bytes_scanned >= ctx->next_check) {
+		ctx->next_check = ctx->bytes_scanned + EVAL_CHECK_INTERVAL;
+
+		if (deadline_passed(limits)) {
+			return -ETIMEDOUT;
+		}
 	}
 
-	*result = new_pos;
 	return 0;
 }
 
-int eval_regex(struct token *regex, const char *start, const size_t size,
-	       const char *pos, token_type_t prefix, const char **result)
+/* records the work done by a primary expression; only called if ctx->stats is set */
+static void eval_stats_primary(struct eval_context *ctx, const size_t bytes, const size_t newlines)
 {
-	if (!regex || !start || !pos || !result) {
-		return -EINVAL;
+	struct telex_stats *stats;
+
+	stats = ctx->stats;
+
+	if (stats->num_primaries < TELEX_STATS_PRIMARIES) {
+		stats->primary_bytes[stats->num_primaries] = bytes;
 	}
 
-	return -ENOSYS;
+	stats->num_primaries++;
+	stats->bytes_scanned += bytes;
+	stats->newlines_crossed += newlines;
+}
+
+/* runs a primitive in pieces, so that limits are checked while it is running */
+static int eval_primitive(struct eval_context *ctx, struct primitive *prim,
+			  int (*step)(struct primitive*, size_t*, const char**),
+			  const char **result)
+{
+	size_t crossed;
+	size_t budget;
+	int limit;
+	int err;
+
+	do {
+		budget = EVAL_CHECK_INTERVAL;
+		crossed = prim->crossed;
+		err = step(prim, &budget, result);
+
+		/* steps that scanned nothing can't exceed a limit */
+		if ((budget < EVAL_CHECK_INTERVAL || prim->crossed > crossed) &&
+		    (limit = eval_charge(ctx, EVAL_CHECK_INTERVAL - budget,
+					 prim->crossed - crossed)) < 0) {
+			return limit;
+		}
+	} while (err == -EINPROGRESS);
+
+	return err;
 }
 
-static const char* find_char(const char *start,
-                             const char *pos,
-                             int dir,
-                             int chr)
+/* adds the bytes that an index had to compare to *indexed */
+static const char* find_string(struct eval_context *ctx, struct token *string,
+			       const char *pos, const int backward, telex_search_t *search,
+			       size_t *indexed)
 {
-	if (dir > 0) {
-		return strchr(pos, chr);
+	struct telex_doc *doc;
+	size_t offset;
+	size_t last;
+	int err;
+
+	doc = ctx->doc;
+
+	if (doc && doc->suffix_index && string->lexeme_len > 0) {
+		*search = TELEX_SEARCH_SUFFIX_INDEX;
+
+		if (backward) {
+			err = suffix_index_prev(doc->suffix_index, string->lexeme,
+						string->lexeme_len, pos - ctx->start, &offset);
+		} else {
+			err = suffix_index_next(doc->suffix_index, string->lexeme,
+						string->lexeme_len, pos - ctx->start, &offset);
+		}
+
+		return err < 0 ? NULL : ctx->start + offset;
+	}
+
+	if (doc && doc->trigram_index && string->lexeme_len > 0) {
+		*search = TELEX_SEARCH_TRIGRAM_INDEX;
+
+		if (backward) {
+			return trigram_index_rfind(doc->trigram_index, ctx->start, ctx->size,
+						   pos, string->lexeme, string->lexeme_len, indexed);
+		}
+
+		return trigram_index_find(doc->trigram_index, ctx->start, ctx->size,
+					  pos, string->lexeme, string->lexeme_len, indexed);
+	}
+
+	if (doc && doc->parallel_pool) {
+		*search = TELEX_SEARCH_PARALLEL;
+
+		if (backward) {
+			return parallel_rfind(doc->parallel_pool, ctx->start, ctx->size,
+					      pos, string->lexeme, string->lexeme_len);
+		}
+
+		return parallel_find(doc->parallel_pool, ctx->start, ctx->size,
+				     pos, string->lexeme, string->lexeme_len);
 	}
 
-	while (pos >= start) {
-		if (*pos == chr) {
-			return pos;
+	*search = TELEX_SEARCH_SCAN;
+
+	if (backward) {
+		/* the last match that starts at or before pos */
+		last = (size_t)(pos - ctx->start) + 1;
+
+		if (string->lexeme_len > ctx->size) {
+			return NULL;
 		}
 
-		pos--;
+		if (last > ctx->size - string->lexeme_len + 1) {
+			last = ctx->size - string->lexeme_len + 1;
+		}
+
+		return search_last(ctx->start, 0, last, string->lexeme, string->lexeme_len);
 	}
 
-	return NULL;
+	return strstr(pos, string->lexeme);
 }
 
-int eval_line_expr(struct line_expr *expr, const char *start, const size_t size,
-		   const char *pos, token_type_t prefix, const char **result)
+int eval_string(struct stringy *stringy, struct eval_context *ctx,
+		const char *pos, token_type_t prefix, const char **result)
 {
-	long long steps;
-	int dir;
-
-	if (!expr || !start || !pos || !result) {
+	struct primitive prim;
+	telex_search_t search;
+	const char *first;
+	const char *last;
+	const char *end;
+	size_t indexed;
+	size_t len;
+	int err;
+
+	if (!stringy || !stringy->token || !ctx || !pos || !result) {
 		return -EINVAL;
 	}
 
-	if (!expr->integer) {
-		return -EBADFD;
+	if ((err = primitive_string_init(&prim, stringy, ctx->start, ctx->size, pos, prefix)) < 0) {
+		return err;
 	}
 
-	steps = expr->integer->integer;
-	dir = (prefix == TOKEN_LESS || prefix == TOKEN_DLESS) ? -1 : +1;
+	len = prim.string->lexeme_len;
+	end = ctx->start + ctx->size;
+	indexed = 0;
+
+	/*
+	 * scoped searches scan the few lines they may match in, instead of
+	 * using an index, and the indexes don't fold case
+	 */
+	if (ctx->limits || stringy->scope || stringy->nocase || !len) {
+		err = eval_primitive(ctx, &prim, primitive_string, result);
+		search = TELEX_SEARCH_SCAN;
+	} else {
+		do {
+			err = primitive_string_found(&prim, find_string(ctx, prim.string,
+									primitive_string_from(&prim),
+									prim.dir < 0, &search, &indexed),
+						     result);
+		} while (err == -EINPROGRESS);
+	}
 
-	if (prefix == TOKEN_DLESS || prefix == TOKEN_DGREATER) {
-		steps++;
-	} else if (prefix == TOKEN_INVALID) {
-		/* when making absolute movements, :1 is the first line, not :0 */
-		steps--;
+	if (err < 0 && err != -ENOENT) {
+		return err;
 	}
 
-	if (dir < 0) {
-		while (steps--) {
-			const char *new_pos;
+	if (ctx->stats) {
+		ctx->stats->searches[search] += prim.searches;
+	}
 
-			if (*pos == '\n' && --pos < start) {
-				*result = start;
-				return 0;
-			}
+	/*
+	 * the result depends on everything between pos and the far end of the match,
+	 * or the newline that ends the scope
+	 */
+	if (prim.dir < 0) {
+		first = prim.match ? prim.match : (prim.lo > ctx->start ? prim.lo - 1 : prim.lo);
+		last = pos + len < end ? pos + len : end;
+	} else {
+		first = pos;
+		last = prim.match ? prim.match + len : (prim.hi < end ? prim.hi + 1 : prim.hi);
+	}
 
-			if (!(new_pos = find_char(start, pos, dir, '\n'))) {
-				*result = start;
-				return 0;
-			}
+	eval_scanned(ctx, first, last);
 
-			pos = new_pos;
-		}
+	if (ctx->stats) {
+		/* the suffix index doesn't scan the text, the trigram index scans candidate blocks */
+		eval_stats_primary(ctx, search == TELEX_SEARCH_SCAN || search == TELEX_SEARCH_PARALLEL ?
+				   (size_t)(last - first) : indexed, 0);
+	}
 
-		if (prefix == TOKEN_DLESS) {
-			pos++;
-		}
-	} else {
-		while (steps--) {
-			const char *new_pos;
+	if (err < 0) {
+		return err;
+	}
+
+	if (ctx->span) {
+		eval_span(ctx, prim.match, prim.match + len);
+	}
 
-			if (!(new_pos = find_char(start, pos, dir, '\n'))) {
-				*result = pos + strlen(pos);
-				return 0;
+	return 0;
+}
+
+int eval_regex(struct token *regex, struct eval_context *ctx,
+	       const char *pos, token_type_t prefix, const char **result)
+{
+	if (!regex || !ctx || !pos || !result) {
+		return -EINVAL;
+	}
+
+	return -ENOSYS;
+}
+
+/* moves over the same newlines as primitive_line(), but counts them in parallel */
+static int eval_line_parallel(struct eval_context *ctx, const char *pos, const long long steps,
+			      const int dir, token_type_t prefix, const char **result)
+{
+	const char *origin;
+	const char *newline;
+	size_t crossed;
+
+	origin = pos;
+	crossed = steps;
+
+	if (dir < 0) {
+		if ((newline = parallel_rfind_newline(ctx->doc->parallel_pool, ctx->start,
+						      pos, steps))) {
+			pos = prefix == TOKEN_DLESS ? newline + 1 : newline;
+		} else {
+			if (ctx->stats) {
+				crossed = search_count_newlines(ctx->start, 0, pos - ctx->start);
 			}
 
-			pos = new_pos + 1;
+			pos = ctx->start;
 		}
+	} else {
+		if ((newline = parallel_find_newline(ctx->doc->parallel_pool, ctx->start,
+						     ctx->size, pos, steps))) {
+			pos = prefix == TOKEN_DGREATER ? newline : newline + 1;
+		} else {
+			if (ctx->stats) {
+				crossed = search_count_newlines(ctx->start, pos - ctx->start, ctx->size);
+			}
 
-		if (prefix == TOKEN_DGREATER) {
-			pos--;
+			pos = ctx->start + ctx->size;
 		}
 	}
 
+	if (ctx->stats) {
+		eval_stats_primary(ctx, origin < pos ? (size_t)(pos - origin) : (size_t)(origin - pos),
+				   crossed);
+	}
+
+	if (ctx->span) {
+		eval_span_line(ctx, pos);
+	}
+
+	eval_moved(ctx, origin, pos);
 	*result = pos;
 	return 0;
 }
 
-int eval_col_expr(struct col_expr *expr, const char *start, const size_t size,
-		  const char *pos, token_type_t prefix, const char **result)
+int eval_line_expr(struct line_expr *expr, struct eval_context *ctx,
+		   const char *pos, token_type_t prefix, const char **result)
 {
-	long long steps;
-	int dir;
+	struct primitive prim;
+	int err;
 
-	if (!expr || !start || !pos || !result) {
+	if (!expr || !ctx || !pos || !result) {
 		return -EINVAL;
 	}
 
-	if (!expr->integer) {
-		return -EBADFD;
+	if ((err = primitive_line_init(&prim, expr, ctx->start, ctx->size, pos, prefix)) < 0) {
+		return err;
+	}
+
+	if (ctx->doc && ctx->doc->parallel_pool && !ctx->limits &&
+	    prim.remaining > 0 && prim.remaining < ULLONG_MAX) {
+		return eval_line_parallel(ctx, pos, prim.remaining, prim.dir, prefix, result);
 	}
 
-	steps = expr->integer->integer;
-	dir = (prefix == TOKEN_LESS || prefix == TOKEN_DLESS) ? -1 : +1;
-	if (steps < 0) {
-		dir = -dir;
-		steps = -steps;
+	if ((err = eval_primitive(ctx, &prim, primitive_line, result)) < 0) {
+		return err;
 	}
 
-	while (steps--) {
-		const char *new_pos;
+	if (ctx->stats) {
+		eval_stats_primary(ctx, pos < *result ? (size_t)(*result - pos) : (size_t)(pos - *result),
+				   prim.crossed);
+	}
 
-		new_pos = pos + dir;
+	if (ctx->span) {
+		eval_span_line(ctx, *result);
+	}
 
-		if (new_pos < start || new_pos > (start + size) || *new_pos == '\n') {
-			if (*new_pos == '\n' && dir > 0) {
-				pos = new_pos;
-			}
-			break;
-		}
+	eval_moved(ctx, pos, *result);
+	return 0;
+}
 
-		pos = new_pos;
+int eval_col_expr(struct col_expr *expr, struct eval_context *ctx,
+		  const char *pos, token_type_t prefix, const char **result)
+{
+	struct primitive prim;
+	int err;
+
+	if (!expr || !ctx || !pos || !result) {
+		return -EINVAL;
 	}
 
-	*result = pos;
+	if ((err = primitive_col_init(&prim, expr, ctx->start, ctx->size, pos, prefix)) < 0) {
+		return err;
+	}
+
+	if ((err = eval_primitive(ctx, &prim, primitive_col, result)) < 0) {
+		return err;
+	}
+
+	if (ctx->stats) {
+		eval_stats_primary(ctx, pos < *result ? (size_t)(*result - pos) : (size_t)(pos - *result), 0);
+	}
+
+	if (ctx->span) {
+		eval_span(ctx, pos, *result);
+	}
+
+	eval_moved(ctx, pos, *result);
 	return 0;
 }
 
-int eval_stringy(struct stringy *stringy, const char *start, const size_t size,
+int eval_stringy(struct stringy *stringy, struct eval_context *ctx,
 		 const char *pos, token_type_t prefix, const char **result)
 {
-	if (!stringy || !start || !pos || !result) {
+	if (!stringy || !ctx || !pos || !result) {
 		return -EINVAL;
 	}
 
 	switch (stringy->token->type) {
 	case TOKEN_STRING:
-		return eval_string(stringy->token, start, size, pos, prefix, result);
+		return eval_string(stringy, ctx, pos, prefix, result);
 
 	case TOKEN_REGEX:
-		return eval_regex(stringy->token, start, size, pos, prefix, result);
+		return eval_regex(stringy->token, ctx, pos, prefix, result);
 
 	default:
 		return -EBADFD;
 	}
 }
 
-int eval_primary_expr(struct primary_expr *expr, const char *start, const size_t size,
-		      const char *pos, token_type_t prefix, const char **result)
+static inline int primary_kind(const struct primary_expr *expr)
 {
-	if (!expr || !start || !pos || !result) {
-		return -EINVAL;
+	if (expr->stringy) {
+		return expr->stringy->token->type == TOKEN_REGEX ?
+			PROBE_PRIMARY_REGEX : PROBE_PRIMARY_STRING;
+	}
+
+	if (expr->line_expr) {
+		return PROBE_PRIMARY_LINE;
 	}
 
+	return expr->col_expr ? PROBE_PRIMARY_COL : PROBE_PRIMARY_TELEX;
+}
+
+static int eval_primary(struct primary_expr *expr, struct eval_context *ctx,
+			const char *pos, token_type_t prefix, const char **result)
+{
 	if (expr->stringy) {
-		return eval_stringy(expr->stringy, start, size, pos, prefix, result);
+		return eval_stringy(expr->stringy, ctx, pos, prefix, result);
 	}
 
 	if (expr->line_expr) {
-		return eval_line_expr(expr->line_expr, start, size, pos, prefix, result);
+		return eval_line_expr(expr->line_expr, ctx, pos, prefix, result);
 	}
 
 	if (expr->col_expr) {
-		return eval_col_expr(expr->col_expr, start, size, pos, prefix, result);
+		return eval_col_expr(expr->col_expr, ctx, pos, prefix, result);
 	}
 
 	if (expr->telex) {
-		return eval_telex(expr->telex, start, size, pos, prefix, result);
+		return eval_telex(expr->telex, ctx, pos, prefix, result);
 	}
 
 	return -EBADFD;
 }
 
-int eval_or_expr(struct or_expr *expr, const char *start, const size_t size,
-		 const char *pos, token_type_t prefix, const char **result)
+int eval_primary_expr(struct primary_expr *expr, struct eval_context *ctx,
+		      const char *pos, token_type_t prefix, const char **result)
 {
-	if (!expr || !start || !pos || !result) {
+	int err;
+
+	if (!expr || !ctx || !pos || !result) {
 		return -EINVAL;
 	}
 
-	if (expr->or_expr) {
-		int err;
+	PROBE3(primary__start, primary_kind(expr), (long)(pos - ctx->start), (int)prefix);
+	err = eval_primary(expr, ctx, pos, prefix, result);
+	PROBE4(primary__done, primary_kind(expr), (long)(pos - ctx->start),
+	       err < 0 ? -1L : (long)(*result - ctx->start), err);
 
-		err = eval_or_expr(expr->or_expr, start, size, pos, prefix, result);
+	return err;
+}
+
+/* alternatives are only counted if there is more than one of them */
+static int eval_or_chain(struct or_expr *expr, struct eval_context *ctx, const char *pos,
+			 token_type_t prefix, const char **result, const int chained)
+{
+	int err;
+
+	if (!expr || !ctx || !pos || !result) {
+		return -EINVAL;
+	}
+
+	if (expr->or_expr) {
+		err = eval_or_chain(expr->or_expr, ctx, pos, prefix, result, 1);
 
 		if (err >= 0) {
 			return err;
 		}
 	}
 
-	return eval_primary_expr(expr->primary_expr, start, size, pos, prefix, result);
+	if (ctx->profile) {
+		struct profile_mark mark;
+
+		profile_enter(ctx, &mark);
+		err = eval_primary_expr(expr->primary_expr, ctx, pos, prefix, result);
+		profile_leave(ctx, expr, &mark, err);
+	} else {
+		err = eval_primary_expr(expr->primary_expr, ctx, pos, prefix, result);
+	}
+
+	if (ctx->stats && chained) {
+		ctx->stats->alternatives_tried++;
+
+		if (err < 0) {
+			ctx->stats->alternatives_failed++;
+		}
+	}
+
+	return err;
 }
 
-int eval_compound_expr(struct compound_expr *expr, const char *start, const size_t size,
-                       const char *pos, token_type_t prefix, const char **result)
+int eval_or_expr(struct or_expr *expr, struct eval_context *ctx,
+		 const char *pos, token_type_t prefix, const char **result)
+{
+	return eval_or_chain(expr, ctx, pos, prefix, result, expr && expr->or_expr);
+}
+
+int eval_compound_step(struct compound_expr *step, struct eval_context *ctx,
+		       const char *pos, token_type_t prefix, const char **result)
 {
 	token_type_t effective_prefix;
 
-	if (!expr || !start || !pos || !result) {
+	if (!step || !ctx || !pos || !result) {
 		return -EINVAL;
 	}
 
-	if (expr->compound_expr) {
+	effective_prefix = step->prefix ? step->prefix->type : prefix;
+
+	if (ctx->profile) {
+		struct profile_mark mark;
 		int err;
 
-		err = eval_compound_expr(expr->compound_expr, start, size, pos, prefix, &pos);
+		profile_enter(ctx, &mark);
+		err = eval_or_expr(step->or_expr, ctx, pos, effective_prefix, result);
+		profile_leave(ctx, step, &mark, err);
+
+		return err;
+	}
+
+	return eval_or_expr(step->or_expr, ctx, pos, effective_prefix, result);
+}
+
+/* if positions is not NULL, the result of every step is appended to it */
+static int eval_compound_chain(struct compound_expr *expr, struct eval_context *ctx,
+			       const char *pos, token_type_t prefix, const char **result,
+			       const char ***positions)
+{
+	int err;
+
+	if (!expr || !ctx || !pos || !result) {
+		return -EINVAL;
+	}
+
+	if (expr->compound_expr) {
+		err = eval_compound_chain(expr->compound_expr, ctx, pos, prefix, &pos, positions);
 
 		if (err < 0) {
 			return err;
 		}
 	}
 
-	effective_prefix = expr->prefix ? expr->prefix->type : prefix;
+	if ((err = eval_compound_step(expr, ctx, pos, prefix, result)) < 0) {
+		return err;
+	}
+
+	if (positions) {
+		*(*positions)++ = *result;
+	}
 
-	return eval_or_expr(expr->or_expr, start, size, pos, effective_prefix, result);
+	return err;
 }
 
-int eval_telex(struct telex *telex, const char *start, const size_t size,
+int eval_compound_expr(struct compound_expr *expr, struct eval_context *ctx,
+                       const char *pos, token_type_t prefix, const char **result)
+{
+	return eval_compound_chain(expr, ctx, pos, prefix, result, NULL);
+}
+
+int eval_telex(struct telex *telex, struct eval_context *ctx,
                const char *pos, token_type_t prefix, const char **result)
+{
+	return eval_telex_steps(telex, ctx, pos, prefix, result, NULL);
+}
+
+int eval_telex_steps(struct telex *telex, struct eval_context *ctx, const char *pos,
+		     token_type_t prefix, const char **result, const char ***positions)
 {
 	token_type_t effective_prefix;
+	int err;
 
-	if (!telex || !start || !result) {
+	if (!telex || !ctx || !result) {
 		return -EINVAL;
 	}
 
@@ -291,10 +649,98 @@ int eval_telex(struct telex *telex, const char *start, const size_t size,
 	}
 
 	if (!pos) {
-		pos = start;
+		pos = ctx->start;
 	}
 
 	effective_prefix = telex->prefix ? telex->prefix->type : prefix;
 
-	return eval_compound_expr(telex->compound_expr, start, size, pos, effective_prefix, result);
+	PROBE3(eval__start, telex, (long)(pos - ctx->start), ctx->size);
+	err = eval_compound_chain(telex->compound_expr, ctx, pos, effective_prefix, result,
+				  positions);
+	PROBE4(eval__done, telex, (long)(pos - ctx->start),
+	       err < 0 ? -1L : (long)(*result - ctx->start), err);
+
+	return err;
+}
+
+/* evaluates the steps of a telex, and fills in *first with the span of the first one */
+static int eval_chain_first_span(struct compound_expr *expr, struct eval_context *ctx,
+				 const char *pos, token_type_t prefix, const char **result,
+				 struct telex_span *first)
+{
+	struct telex_span *span;
+	int err;
+
+	if (expr->compound_expr) {
+		err = eval_chain_first_span(expr->compound_expr, ctx, pos, prefix, &pos, first);
+
+		if (err < 0) {
+			return err;
+		}
+
+		return eval_compound_step(expr, ctx, pos, prefix, result);
+	}
+
+	span = ctx->span;
+	ctx->span = first;
+	err = eval_compound_step(expr, ctx, pos, prefix, result);
+	ctx->span = span;
+
+	return err;
+}
+
+int eval_telex_first_span(struct telex *telex, struct eval_context *ctx, const char *pos,
+			  token_type_t prefix, const char **result, struct telex_span *first)
+{
+	if (!telex || !telex->compound_expr || !ctx || !pos || !result || !first) {
+		return -EINVAL;
+	}
+
+	if (telex->prefix) {
+		prefix = telex->prefix->type;
+	}
+
+	return eval_chain_first_span(telex->compound_expr, ctx, pos, prefix, result, first);
+}
+
+int eval_range_end(struct telex_range *range, struct eval_context *ctx, const char *begin,
+		   struct telex_span *span)
+{
+	const char *end;
+	int err;
+
+	if (!range || !range->end || !ctx || !begin || !span) {
+		return -EINVAL;
+	}
+
+	if ((err = eval_telex(range->end, ctx, begin,
+			      range->end->prefix ? range->end->prefix->type : TOKEN_INVALID,
+			      &end)) < 0) {
+		return err;
+	}
+
+	/* the end may be searched for backwards */
+	span->begin = begin < end ? begin : end;
+	span->end = begin < end ? end : begin;
+
+	return 0;
+}
+
+int eval_range(struct telex_range *range, struct eval_context *ctx, const char *pos,
+	       struct telex_span *span)
+{
+	const char *begin;
+	int err;
+
+	if (!range || !range->start || !ctx || !span) {
+		return -EINVAL;
+	}
+
+	if ((err = eval_telex(range->start, ctx, pos,
+			      range->start->prefix ? range->start->prefix->type : TOKEN_INVALID,
+			      &begin)) < 0) {
+		return err;
+	}
+
+	return eval_range_end(range, ctx, begin, span);
 }
@@ -0,0 +1,77 @@
+/*
+ * eval.h - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef EVAL_H
+#define EVAL_H
+
+#include <stddef.h>
+#include "telex.h"
+#include "token.h"
+#include "doc.h"
+#include "stats.h"
+#include "profile.h"
+
+struct eval_context {
+	const char *start;
+	size_t size;
+
+	/* optional; lookups use the document's indices if there is one */
+	struct telex_doc *doc;
+
+	/* the part of the text that the results evaluated so far depend on */
+	const char *scan_first;
+	const char *scan_last;
+
+	/* optional; the work done so far is only counted if there are limits */
+	const struct telex_limits *limits;
+	size_t bytes_scanned;
+	size_t lines_crossed;
+	size_t next_check;
+
+	/* optional; counters are only updated if this is set */
+	struct telex_stats *stats;
+
+	/* optional; requires stats, since it records the bytes they count */
+	struct telex_profile *profile;
+
+	/* optional; receives what the last primary expression matched or moved over */
+	struct telex_span *span;
+};
+
+void eval_context_init(struct eval_context *ctx, const char *start, const size_t size,
+		       struct telex_doc *doc);
+
+int eval_compound_step(struct compound_expr *step, struct eval_context *ctx,
+		       const char *pos, token_type_t prefix, const char **result);
+int eval_telex(struct telex *telex, struct eval_context *ctx,
+	       const char *pos, token_type_t prefix, const char **result);
+/* like eval_telex(), and appends the result of every step to *positions */
+int eval_telex_steps(struct telex *telex, struct eval_context *ctx, const char *pos,
+		     token_type_t prefix, const char **result, const char ***positions);
+/* like eval_telex(), and fills in *first with the span of the first step */
+int eval_telex_first_span(struct telex *telex, struct eval_context *ctx, const char *pos,
+			  token_type_t prefix, const char **result, struct telex_span *first);
+/* evaluates the start of a range from pos, and its end from there */
+int eval_range(struct telex_range *range, struct eval_context *ctx, const char *pos,
+	       struct telex_span *span);
+int eval_range_end(struct telex_range *range, struct eval_context *ctx, const char *begin,
+		   struct telex_span *span);
+
+#endif /* EVAL_H */
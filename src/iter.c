@@ -0,0 +1,120 @@
+/*
+ * iter.c - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <telex/iter.h>
+#include <errno.h>
+#include "telex.h"
+#include "eval.h"
+#include "stats.h"
+
+/*
+ * The first step of a telex decides where it leads: evaluating it from
+ * anywhere between pos and the start of what it matched has the same
+ * result. So the next hit is searched for right after that start, and
+ * the search for the first step continues where it stopped.
+ */
+
+int telex_iter_init(struct telex_iter *iter, struct telex *telex,
+		    const char *start, const size_t size, const char *pos)
+{
+	struct compound_expr *first;
+	token_type_t prefix;
+
+	if (!iter || !telex || !telex->compound_expr || !start ||
+	    (pos && (pos < start || pos > start + size))) {
+		return -EINVAL;
+	}
+
+	if (telex->prefix && !pos) {
+		return -EBADMSG;
+	}
+
+	for (first = telex->compound_expr; first->compound_expr; first = first->compound_expr);
+
+	prefix = first->prefix ? first->prefix->type :
+		telex->prefix ? telex->prefix->type : TOKEN_INVALID;
+
+	iter->telex = telex;
+	iter->start = start;
+	iter->size = size;
+	iter->backward = prefix == TOKEN_LESS || prefix == TOKEN_DLESS;
+	iter->pos = pos ? pos : start;
+	iter->last = NULL;
+
+	return 0;
+}
+
+/* the position after the first step's match, or before it if searching backwards */
+static const char* iter_advance(struct telex_iter *iter, const char *match)
+{
+	if (iter->backward) {
+		if (match >= iter->pos) {
+			match = iter->pos;
+		}
+
+		return match > iter->start ? match - 1 : NULL;
+	}
+
+	if (match < iter->pos) {
+		match = iter->pos;
+	}
+
+	return match < iter->start + iter->size ? match + 1 : NULL;
+}
+
+const char* telex_iter_next(struct telex_iter *iter)
+{
+	if (!iter) {
+		return NULL;
+	}
+
+	while (iter->pos) {
+		struct telex_stats scratch;
+		struct telex_span first;
+		struct eval_context ctx;
+		const char *result;
+		int err;
+
+		eval_context_init(&ctx, iter->start, iter->size, NULL);
+		stats_start(&ctx, NULL, &scratch);
+		first.begin = NULL;
+		first.end = NULL;
+
+		err = eval_telex_first_span(iter->telex, &ctx, iter->pos, TOKEN_INVALID,
+					    &result, &first);
+		stats_finish(&ctx);
+
+		/* if the first step has no more hits, neither does the telex */
+		if (!first.begin) {
+			iter->pos = NULL;
+			break;
+		}
+
+		iter->pos = iter_advance(iter, first.begin);
+
+		/* later steps may fail after some hits of the first, or lead to the same place */
+		if (err >= 0 && result != iter->last) {
+			iter->last = result;
+			return result;
+		}
+	}
+
+	return NULL;
+}
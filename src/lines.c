@@ -0,0 +1,242 @@
+/*
+ * lines.c - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "lines.h"
+#include "search.h"
+
+/*
+ * The index remembers where every interval-th line starts, so checkpoint k
+ * is the offset of line k * interval + 1. Everything between two
+ * checkpoints is counted when it is needed.
+ */
+
+#define SCAN_BLOCK 4096
+
+struct line_index {
+	size_t interval;
+	size_t *checkpoints;
+	size_t num_checkpoints;
+	size_t max_checkpoints;
+};
+
+static int add_checkpoint(struct line_index *index, const size_t offset)
+{
+	if (index->num_checkpoints == index->max_checkpoints) {
+		size_t *checkpoints;
+		size_t max;
+
+		max = index->max_checkpoints ? index->max_checkpoints * 2 : 64;
+
+		if (!(checkpoints = realloc(index->checkpoints, max * sizeof(*checkpoints)))) {
+			return -ENOMEM;
+		}
+
+		index->checkpoints = checkpoints;
+		index->max_checkpoints = max;
+	}
+
+	index->checkpoints[index->num_checkpoints++] = offset;
+	return 0;
+}
+
+/* adds the checkpoints after the last one */
+static int scan(struct line_index *index, const char *text, const size_t size)
+{
+	size_t newlines;
+	size_t lo;
+	size_t hi;
+	int err;
+
+	newlines = 0;
+
+	for (lo = index->checkpoints[index->num_checkpoints - 1]; lo < size; lo = hi) {
+		size_t count;
+
+		hi = size - lo > SCAN_BLOCK ? lo + SCAN_BLOCK : size;
+		count = search_count_newlines(text, lo, hi);
+
+		/* there may be more than one checkpoint in a block if lines are short */
+		while (newlines + count >= index->interval) {
+			const char *newline;
+
+			newline = search_newline(text, lo, hi, index->interval - newlines);
+			count -= index->interval - newlines;
+			newlines = 0;
+			lo = newline - text + 1;
+
+			if ((err = add_checkpoint(index, lo)) < 0) {
+				return err;
+			}
+		}
+
+		newlines += count;
+	}
+
+	return 0;
+}
+
+int line_index_new(struct line_index **index, const char *text, const size_t size,
+		   const size_t interval)
+{
+	struct line_index *new;
+	int err;
+
+	if (!index || !text) {
+		return -EINVAL;
+	}
+
+	if (!(new = calloc(1, sizeof(*new)))) {
+		return -ENOMEM;
+	}
+
+	new->interval = interval ? interval : LINE_INDEX_INTERVAL;
+
+	if ((err = add_checkpoint(new, 0)) < 0 ||
+	    (err = scan(new, text, size)) < 0) {
+		line_index_free(&new);
+		return err;
+	}
+
+	*index = new;
+	return 0;
+}
+
+void line_index_free(struct line_index **index)
+{
+	if (index && *index) {
+		free((*index)->checkpoints);
+		free(*index);
+		*index = NULL;
+	}
+}
+
+/* the last checkpoint at or before offset */
+static size_t checkpoint_before(const struct line_index *index, const size_t offset)
+{
+	size_t lo;
+	size_t hi;
+
+	lo = 0;
+	hi = index->num_checkpoints;
+
+	while (hi - lo > 1) {
+		size_t mid;
+
+		mid = lo + (hi - lo) / 2;
+
+		if (index->checkpoints[mid] <= offset) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+int line_index_edit(struct line_index *index, const char *text, const size_t size,
+		    const size_t offset)
+{
+	if (!index || !text) {
+		return -EINVAL;
+	}
+
+	/* lines that start at or before the change are where they were */
+	index->num_checkpoints = checkpoint_before(index, offset) + 1;
+
+	return scan(index, text, size);
+}
+
+int line_index_position(const struct line_index *index, const char *text, const size_t size,
+			const size_t offset, size_t *line, size_t *col)
+{
+	const char *newline;
+	size_t checkpoint;
+	size_t first;
+
+	if (!text || !line || !col || offset > size) {
+		return -EINVAL;
+	}
+
+	if (index) {
+		checkpoint = checkpoint_before(index, offset);
+		first = index->checkpoints[checkpoint];
+		*line = checkpoint * index->interval + 1;
+	} else {
+		first = 0;
+		*line = 1;
+	}
+
+	*line += search_count_newlines(text, first, offset);
+	newline = memrchr(text + first, '\n', offset - first);
+	*col = offset - (newline ? (size_t)(newline - text) + 1 : first);
+
+	return 0;
+}
+
+int line_index_offset(const struct line_index *index, const char *text, const size_t size,
+		      const size_t line, const size_t col, size_t *offset)
+{
+	const char *newline;
+	size_t checkpoint;
+	size_t first;
+	size_t skip;
+	size_t len;
+
+	if (!text || !offset || !line) {
+		return -EINVAL;
+	}
+
+	if (index) {
+		checkpoint = (line - 1) / index->interval;
+
+		if (checkpoint >= index->num_checkpoints) {
+			checkpoint = index->num_checkpoints - 1;
+		}
+
+		first = index->checkpoints[checkpoint];
+		skip = line - 1 - checkpoint * index->interval;
+	} else {
+		first = 0;
+		skip = line - 1;
+	}
+
+	if (skip) {
+		if (!(newline = search_newline(text, first, size, skip))) {
+			return -ERANGE;
+		}
+
+		first = newline - text + 1;
+	}
+
+	/* the column may point at the newline, but not past it */
+	len = size - first < col ? size - first : col;
+
+	if (col > len || memchr(text + first, '\n', len)) {
+		return -ERANGE;
+	}
+
+	*offset = first + col;
+	return 0;
+}
@@ -0,0 +1,42 @@
+/*
+ * lines.h - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef LINES_H
+#define LINES_H
+
+#include <stddef.h>
+
+#define LINE_INDEX_INTERVAL 256
+
+struct line_index;
+
+int line_index_new(struct line_index **index, const char *text, const size_t size,
+		   const size_t interval);
+void line_index_free(struct line_index **index);
+int line_index_edit(struct line_index *index, const char *text, const size_t size,
+		    const size_t offset);
+
+/* index may be NULL, in which case the text is scanned from the start */
+int line_index_position(const struct line_index *index, const char *text, const size_t size,
+			const size_t offset, size_t *line, size_t *col);
+int line_index_offset(const struct line_index *index, const char *text, const size_t size,
+		      const size_t line, const size_t col, size_t *offset);
+
+#endif /* LINES_H */
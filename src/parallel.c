@@ -0,0 +1,470 @@
+/*
+ * parallel.c - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "parallel.h"
+#include "search.h"
+
+/*
+ * A search range is cut into chunks that are numbered in search order, so
+ * for backward searches chunk 0 is the one closest to the start position.
+ * The workers take chunks in that order. Once a chunk contains a hit, no
+ * chunks after it are taken anymore, but all chunks before it have already
+ * been taken and will be finished, so the hit in the lowest chunk is the
+ * one a sequential search would have found.
+ */
+
+#define NOT_COUNTED SIZE_MAX
+
+struct parallel_job {
+	const char *text;
+	size_t first;
+	size_t last;
+	size_t num_chunks;
+	size_t chunk_size;
+	int backward;
+
+	/* string searches */
+	const char *needle;
+	size_t len;
+	pthread_mutex_t lock;
+	const char *hit;
+
+	/* newline searches */
+	size_t count;
+	size_t *counts;
+	atomic_size_t total;
+
+	atomic_size_t next;
+	atomic_size_t found;
+};
+
+struct parallel_pool {
+	pthread_t *threads;
+	int num_threads;
+	size_t chunk_size;
+
+	/* only one job runs at a time */
+	pthread_mutex_t run_lock;
+
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	pthread_cond_t done;
+	struct parallel_job *job;
+	unsigned long generation;
+	int busy;
+	int shutdown;
+};
+
+static void chunk_range(struct parallel_job *job, const size_t chunk,
+			size_t *lo, size_t *hi)
+{
+	size_t offset;
+
+	offset = chunk * job->chunk_size;
+
+	if (job->backward) {
+		*hi = job->last - offset;
+		*lo = *hi - job->first > job->chunk_size ? *hi - job->chunk_size : job->first;
+	} else {
+		*lo = job->first + offset;
+		*hi = job->last - *lo > job->chunk_size ? *lo + job->chunk_size : job->last;
+	}
+}
+
+static void scan_string(struct parallel_job *job, const size_t chunk)
+{
+	const char *hit;
+	size_t lo;
+	size_t hi;
+
+	chunk_range(job, chunk, &lo, &hi);
+
+	if (job->backward) {
+		hit = search_last(job->text, lo, hi, job->needle, job->len);
+	} else {
+		/* chunks overlap by len - 1 bytes, so matches may start anywhere in [lo, hi) */
+		hit = memmem(job->text + lo, hi - lo + job->len - 1, job->needle, job->len);
+	}
+
+	if (!hit) {
+		return;
+	}
+
+	pthread_mutex_lock(&job->lock);
+
+	if (chunk < atomic_load(&job->found)) {
+		atomic_store(&job->found, chunk);
+		job->hit = hit;
+	}
+
+	pthread_mutex_unlock(&job->lock);
+}
+
+static void scan_newlines(struct parallel_job *job, const size_t chunk)
+{
+	size_t count;
+	size_t lo;
+	size_t hi;
+
+	chunk_range(job, chunk, &lo, &hi);
+	count = search_count_newlines(job->text, lo, hi);
+
+	job->counts[chunk] = count;
+	atomic_fetch_add(&job->total, count);
+}
+
+static void job_run(struct parallel_job *job)
+{
+	for (;;) {
+		size_t chunk;
+
+		chunk = atomic_fetch_add(&job->next, 1);
+
+		if (chunk >= job->num_chunks || chunk > atomic_load(&job->found)) {
+			break;
+		}
+
+		if (job->needle) {
+			scan_string(job, chunk);
+		} else if (atomic_load(&job->total) < job->count) {
+			scan_newlines(job, chunk);
+		} else {
+			break;
+		}
+	}
+}
+
+static void* worker_main(void *data)
+{
+	struct parallel_pool *pool;
+	unsigned long generation;
+
+	pool = (struct parallel_pool*)data;
+	generation = 0;
+
+	for (;;) {
+		struct parallel_job *job;
+
+		pthread_mutex_lock(&pool->lock);
+
+		while (pool->generation == generation && !pool->shutdown) {
+			pthread_cond_wait(&pool->work, &pool->lock);
+		}
+
+		if (pool->shutdown) {
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+
+		generation = pool->generation;
+		job = pool->job;
+		pthread_mutex_unlock(&pool->lock);
+
+		job_run(job);
+
+		pthread_mutex_lock(&pool->lock);
+
+		if (--pool->busy == 0) {
+			pthread_cond_signal(&pool->done);
+		}
+
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	return NULL;
+}
+
+static void pool_run(struct parallel_pool *pool, struct parallel_job *job)
+{
+	pthread_mutex_lock(&pool->lock);
+	pool->job = job;
+	pool->generation++;
+	pool->busy = pool->num_threads;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	/* the calling thread is one of the workers */
+	job_run(job);
+
+	pthread_mutex_lock(&pool->lock);
+
+	while (pool->busy > 0) {
+		pthread_cond_wait(&pool->done, &pool->lock);
+	}
+
+	pool->job = NULL;
+	pthread_mutex_unlock(&pool->lock);
+}
+
+static void pool_stop(struct parallel_pool *pool)
+{
+	int i;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->shutdown = 1;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < pool->num_threads; i++) {
+		pthread_join(pool->threads[i], NULL);
+	}
+}
+
+int parallel_pool_new(struct parallel_pool **pool, const int num_threads,
+		      const size_t chunk_size)
+{
+	struct parallel_pool *new;
+	int err;
+
+	if (!pool || num_threads < 1) {
+		return -EINVAL;
+	}
+
+	if (!(new = calloc(1, sizeof(*new)))) {
+		return -ENOMEM;
+	}
+
+	new->chunk_size = chunk_size ? chunk_size : PARALLEL_CHUNK_SIZE;
+
+	if (!(new->threads = calloc(num_threads, sizeof(*new->threads)))) {
+		free(new);
+		return -ENOMEM;
+	}
+
+	pthread_mutex_init(&new->run_lock, NULL);
+	pthread_mutex_init(&new->lock, NULL);
+	pthread_cond_init(&new->work, NULL);
+	pthread_cond_init(&new->done, NULL);
+
+	/* the thread that starts a job works on it, too */
+	while (new->num_threads < num_threads - 1) {
+		if ((err = pthread_create(&new->threads[new->num_threads], NULL,
+					  worker_main, new)) != 0) {
+			parallel_pool_free(&new);
+			return -err;
+		}
+
+		new->num_threads++;
+	}
+
+	*pool = new;
+	return 0;
+}
+
+void parallel_pool_free(struct parallel_pool **pool)
+{
+	if (pool && *pool) {
+		pool_stop(*pool);
+
+		pthread_cond_destroy(&(*pool)->done);
+		pthread_cond_destroy(&(*pool)->work);
+		pthread_mutex_destroy(&(*pool)->lock);
+		pthread_mutex_destroy(&(*pool)->run_lock);
+
+		free((*pool)->threads);
+		free(*pool);
+		*pool = NULL;
+	}
+}
+
+static void job_init(struct parallel_job *job, struct parallel_pool *pool,
+		     const char *text, const size_t first, const size_t last,
+		     const int backward)
+{
+	memset(job, 0, sizeof(*job));
+
+	job->text = text;
+	job->first = first;
+	job->last = last;
+	job->backward = backward;
+	job->chunk_size = pool->chunk_size;
+	job->num_chunks = (last - first + pool->chunk_size - 1) / pool->chunk_size;
+
+	atomic_init(&job->next, 0);
+	atomic_init(&job->found, SIZE_MAX);
+	atomic_init(&job->total, 0);
+}
+
+static int worth_splitting(struct parallel_pool *pool, const size_t first, const size_t last)
+{
+	return pool->num_threads > 0 && last > first && last - first > 2 * pool->chunk_size;
+}
+
+static const char* run_string_job(struct parallel_pool *pool, const char *text,
+				  const size_t first, const size_t last,
+				  const char *needle, const size_t len, const int backward)
+{
+	struct parallel_job job;
+
+	job_init(&job, pool, text, first, last, backward);
+	job.needle = needle;
+	job.len = len;
+	pthread_mutex_init(&job.lock, NULL);
+
+	pthread_mutex_lock(&pool->run_lock);
+	pool_run(pool, &job);
+	pthread_mutex_unlock(&pool->run_lock);
+
+	pthread_mutex_destroy(&job.lock);
+	return job.hit;
+}
+
+/* first match that starts at or after pos */
+const char* parallel_find(struct parallel_pool *pool, const char *text,
+			  const size_t size, const char *pos,
+			  const char *needle, const size_t len)
+{
+	size_t first;
+	size_t last;
+
+	first = pos - text;
+
+	if (!len) {
+		return pos;
+	}
+
+	if (len > size || first > size - len) {
+		return NULL;
+	}
+
+	last = size - len + 1;
+
+	if (!worth_splitting(pool, first, last)) {
+		return memmem(pos, size - first, needle, len);
+	}
+
+	return run_string_job(pool, text, first, last, needle, len, 0);
+}
+
+/* last match that starts at or before pos */
+const char* parallel_rfind(struct parallel_pool *pool, const char *text,
+			   const size_t size, const char *pos,
+			   const char *needle, const size_t len)
+{
+	size_t last;
+
+	if (!len) {
+		return pos;
+	}
+
+	if (len > size) {
+		return NULL;
+	}
+
+	last = (size_t)(pos - text) < size - len ? (size_t)(pos - text) + 1 : size - len + 1;
+
+	if (!worth_splitting(pool, 0, last)) {
+		return search_last(text, 0, last, needle, len);
+	}
+
+	return run_string_job(pool, text, 0, last, needle, len, 1);
+}
+
+static const char* run_newline_job(struct parallel_pool *pool, const char *text,
+				   const size_t first, const size_t last,
+				   size_t count, const int backward)
+{
+	struct parallel_job job;
+	size_t chunk;
+
+	job_init(&job, pool, text, first, last, backward);
+	job.count = count;
+
+	if (!(job.counts = malloc(job.num_chunks * sizeof(*job.counts)))) {
+		return backward ? search_rnewline(text, first, last, count) :
+			search_newline(text, first, last, count);
+	}
+
+	for (chunk = 0; chunk < job.num_chunks; chunk++) {
+		job.counts[chunk] = NOT_COUNTED;
+	}
+
+	pthread_mutex_lock(&pool->run_lock);
+	pool_run(pool, &job);
+	pthread_mutex_unlock(&pool->run_lock);
+
+	for (chunk = 0; chunk < job.num_chunks; chunk++) {
+		size_t lo;
+		size_t hi;
+
+		chunk_range(&job, chunk, &lo, &hi);
+
+		/* chunks may have been skipped once the count was reached */
+		if (job.counts[chunk] == NOT_COUNTED) {
+			job.counts[chunk] = search_count_newlines(text, lo, hi);
+		}
+
+		if (job.counts[chunk] >= count) {
+			free(job.counts);
+			return backward ? search_rnewline(text, lo, hi, count) :
+				search_newline(text, lo, hi, count);
+		}
+
+		count -= job.counts[chunk];
+	}
+
+	free(job.counts);
+	return NULL;
+}
+
+/* the count-th newline in [pos, text + size) */
+const char* parallel_find_newline(struct parallel_pool *pool, const char *text,
+				  const size_t size, const char *pos, const size_t count)
+{
+	size_t first;
+
+	first = pos - text;
+
+	if (!count || first >= size) {
+		return NULL;
+	}
+
+	if (!worth_splitting(pool, first, size)) {
+		return search_newline(text, first, size, count);
+	}
+
+	return run_newline_job(pool, text, first, size, count, 0);
+}
+
+/* the count-th newline in [text, pos), counting backwards */
+const char* parallel_rfind_newline(struct parallel_pool *pool, const char *text,
+				   const char *pos, const size_t count)
+{
+	size_t last;
+
+	last = pos - text;
+
+	if (!count || !last) {
+		return NULL;
+	}
+
+	if (!worth_splitting(pool, 0, last)) {
+		return search_rnewline(text, 0, last, count);
+	}
+
+	return run_newline_job(pool, text, 0, last, count, 1);
+}
@@ -0,0 +1,46 @@
+/*
+ * parallel.h - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stddef.h>
+
+#define PARALLEL_CHUNK_SIZE (1024 * 1024)
+
+struct parallel_pool;
+
+int parallel_pool_new(struct parallel_pool **pool, const int num_threads,
+		      const size_t chunk_size);
+void parallel_pool_free(struct parallel_pool **pool);
+
+const char* parallel_find(struct parallel_pool *pool, const char *text,
+			  const size_t size, const char *pos,
+			  const char *needle, const size_t len);
+const char* parallel_rfind(struct parallel_pool *pool, const char *text,
+			   const size_t size, const char *pos,
+			   const char *needle, const size_t len);
+
+const char* parallel_find_newline(struct parallel_pool *pool, const char *text,
+				  const size_t size, const char *pos, const size_t count);
+const char* parallel_rfind_newline(struct parallel_pool *pool, const char *text,
+				   const char *pos, const size_t count);
+
+#endif /* PARALLEL_H */
@@ -103,18 +103,72 @@ struct line_expr* parse_line_expr(struct token **tokens, struct parser *context)
 	return expr;
 }
 
+/* if the next tokens are an integer and a `*', the stringy after them is repeated */
+static int have_repetition(struct token **tokens)
+{
+	struct token *count;
+	struct token *star;
+
+	if (!(count = next_relevant_token(tokens)) || count->type != TOKEN_INTEGER) {
+		return 0;
+	}
+
+	return (star = next_relevant_token(&count->next)) && star->type == TOKEN_STAR;
+}
+
 struct stringy* parse_stringy(struct token **tokens, struct parser *context)
 {
 	struct stringy *stringy;
 
+	/*
+	 * stringy = [ integer '*' ] string [ 'i' ] [ '@' integer ]
+	 *         | [ integer '*' ] string '@' integer 'i'
+	 *         | [ integer '*' ] regex [ '@' integer ]
+	 */
+
 	assert(tokens);
 	assert(*tokens);
 
-	if ((stringy = calloc(1, sizeof(*stringy)))) {
-		if (!(stringy->token = get_token(tokens, TOKEN_STRING, TOKEN_REGEX, 0))) {
-			EXPECTED_GRAMMAR("string or regex", *tokens);
+	if (!(stringy = calloc(1, sizeof(*stringy)))) {
+		return NULL;
+	}
+
+	if (have_repetition(tokens)) {
+		if (next_relevant_token(tokens)->integer < 1) {
+			EXPECTED_GRAMMAR("repetition count greater than zero", tokens);
 			stringy_free(&stringy);
+			return NULL;
 		}
+
+		stringy->count = get_token(tokens, TOKEN_INTEGER, 0);
+		stringy->star = get_token(tokens, TOKEN_STAR, 0);
+	}
+
+	if (!(stringy->token = get_token(tokens, TOKEN_STRING, TOKEN_REGEX, 0))) {
+		EXPECTED_GRAMMAR("string or regex", *tokens);
+		stringy_free(&stringy);
+		return NULL;
+	}
+
+	if (stringy->token->type == TOKEN_STRING) {
+		/* no error checking because the flag is optional */
+		stringy->nocase = get_token(tokens, TOKEN_NOCASE, 0);
+	}
+
+	/* the search is limited to the current line and the next (or previous) N lines */
+	if (have_token(tokens, TOKEN_AT, 0)) {
+		stringy->at = get_token(tokens, TOKEN_AT, 0);
+
+		if (!(stringy->scope = get_token(tokens, TOKEN_INTEGER, 0))) {
+			EXPECTED_GRAMMAR("number of lines", *tokens);
+			stringy_free(&stringy);
+			return NULL;
+		}
+	}
+
+	/* the flag may also follow the scope, as in "AB"@1i */
+	if (stringy->token->type == TOKEN_STRING && !stringy->nocase) {
+		stringy->nocase = get_token(tokens, TOKEN_NOCASE, 0);
 	}
 
 	return stringy;
@@ -133,8 +187,10 @@ struct primary_expr* parse_primary_expr(struct token **tokens, struct parser *co
 	}
 	error = 0;
 
-	if (have_token(tokens, TOKEN_STRING, TOKEN_REGEX, 0)) {
-		expr->stringy = parse_stringy(tokens, context);
+	if (have_token(tokens, TOKEN_STRING, TOKEN_REGEX, 0) || have_repetition(tokens)) {
+		if (!(expr->stringy = parse_stringy(tokens, context))) {
+			error = -EBADMSG;
+		}
 	} else if(have_token(tokens, TOKEN_COLON, 0)) {
 		expr->line_expr = parse_line_expr(tokens, context);
 	} else if(have_token(tokens, TOKEN_POUND, TOKEN_INTEGER, 0)) {
@@ -233,6 +289,8 @@ struct compound_expr* parse_compound_expr(struct token **tokens, struct parser *
 
 		if (!(expr->or_expr = parse_or_expr(tokens, context))) {
 			EXPECTED_GRAMMAR("or-expr", tokens);
+			token_free(&prefix);
+			free(expr);
 			error = -EBADMSG;
 			break;
 		}
@@ -276,14 +334,57 @@ struct telex* parse_telex(struct token **tokens, struct parser *context)
 	return telex;
 }
 
+static int parse_end(struct token **tokens, struct parser *context)
+{
+	/* anything after a complete telex would otherwise be dropped without a word */
+	if (!have_token(tokens, TOKEN_EOF, 0)) {
+		EXPECTED_GRAMMAR("end of input", tokens);
+		return -EBADMSG;
+	}
+
+	return 0;
+}
+
+struct telex_range* parse_range(struct token **tokens, struct parser *context)
+{
+	struct telex_range *range;
+
+	/*
+	 * range = telex ',' telex
+	 */
+
+	assert(tokens);
+	assert(*tokens);
+
+	if (!(range = calloc(1, sizeof(*range)))) {
+		return NULL;
+	}
+
+	if (!(range->start = parse_telex(tokens, context))) {
+		telex_range_free(&range);
+	} else if (!(range->comma = get_token(tokens, TOKEN_COMMA, 0))) {
+		EXPECTED_GRAMMAR("`,'", tokens);
+		telex_range_free(&range);
+	} else if (!(range->end = parse_telex(tokens, context))) {
+		telex_range_free(&range);
+	}
+
+	return range;
+}
+
 void debug_stringy(struct stringy *expr, int depth)
 {
 	if (!expr) {
 		return;
 	}
 
-	fprintf(stderr, "%*sstringy [ %s ]\n", depth, "",
-		expr->token ? expr->token->lexeme : "(null)");
+	fprintf(stderr, "%*sstringy [ %s%s%s%s%s%s ]\n", depth, "",
+		expr->count ? expr->count->lexeme : "",
+		expr->star ? expr->star->lexeme : "",
+		expr->token ? expr->token->lexeme : "(null)",
+		expr->nocase ? expr->nocase->lexeme : "",
+		expr->at ? expr->at->lexeme : "",
+		expr->scope ? expr->scope->lexeme : "");
 }
 
 void debug_line_expr(struct line_expr *expr, int depth)
@@ -419,6 +520,40 @@ int parser_parse(struct parser *parser, const char *input)
 		return -EBADMSG;
 	}
 
+	if (parse_end(&tokens, parser) < 0) {
+		telex_free(&parser->telex);
+		return -EBADMSG;
+	}
+
+	return 0;
+}
+
+int parser_parse_range(struct parser *parser, const char *input)
+{
+	struct token *tokens;
+
+	if (!parser || !input) {
+		return -EINVAL;
+	}
+
+	if (parser->tokens) {
+		return -EALREADY;
+	}
+
+	if (!(parser->tokens = tokenize(input, &parser->errors))) {
+		return -EBADMSG;
+	}
+
+	tokens = parser->tokens;
+	if (!(parser->range = parse_range(&tokens, parser))) {
+		return -EBADMSG;
+	}
+
+	if (parse_end(&tokens, parser) < 0) {
+		telex_range_free(&parser->range);
+		return -EBADMSG;
+	}
+
 	return 0;
 }
 
@@ -426,8 +561,12 @@ void parser_add_error(struct parser *parser, struct telex_error *error)
 {
 	struct telex_error **last;
 
-	for (last = &parser->errors; *last; last = &(*last)->next);
+	/* errors are only ever appended, so the walk starts where the last one ended */
+	for (last = parser->last_error ? parser->last_error : &parser->errors;
+	     *last; last = &(*last)->next);
+
 	*last = error;
+	parser->last_error = last;
 }
 
 struct telex* parser_get_telex(struct parser *parser)
@@ -435,6 +574,11 @@ struct telex* parser_get_telex(struct parser *parser)
 	return parser->telex;
 }
 
+struct telex_range* parser_get_range(struct parser *parser)
+{
+	return parser->range;
+}
+
 struct telex_error* parser_get_errors(struct parser *parser)
 {
 	return parser->errors;
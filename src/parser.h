@@ -28,14 +28,18 @@
 struct parser {
 	struct token *tokens;
 	struct telex *telex;
+	struct telex_range *range;
 	struct telex_error *errors;
+	struct telex_error **last_error;
 };
 
 struct parser* parser_new(void);
 void parser_free(struct parser *parser);
 int parser_parse(struct parser *parser, const char *input);
+int parser_parse_range(struct parser *parser, const char *input);
 
 struct telex* parser_get_telex(struct parser *parser);
+struct telex_range* parser_get_range(struct parser *parser);
 void parser_debug_telex(struct telex *telex);
 struct telex_error* parser_get_errors(struct parser *parser);
 void parser_add_error(struct parser *parser, struct telex_error *error);
@@ -0,0 +1,385 @@
+/*
+ * primitive.c - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include "primitive.h"
+#include "search.h"
+
+/* newlines are counted in small windows, so that short movements and scopes stop near their end */
+#define LINE_WINDOW 4096
+
+static void primitive_init(struct primitive *prim, const char *start, const size_t size,
+			   const char *pos, const token_type_t prefix)
+{
+	memset(prim, 0, sizeof(*prim));
+	prim->start = start;
+	prim->end = start + size;
+	prim->prefix = prefix;
+	prim->dir = prefix == TOKEN_LESS || prefix == TOKEN_DLESS ? -1 : +1;
+	prim->pos = pos;
+	prim->cur = pos;
+}
+
+/*
+ * finds the count-th occurrence of the string; the search for each one starts
+ * after the last. Scoped occurrences have to be on the line of pos or on the
+ * next (or previous) lines. Where the scope ends is found while searching,
+ * so that it costs no more than the search itself.
+ */
+int primitive_string_init(struct primitive *prim, struct stringy *stringy, const char *start,
+			  const size_t size, const char *pos, const token_type_t prefix)
+{
+	size_t len;
+
+	if (!stringy->token || (stringy->count && stringy->count->integer < 1)) {
+		return -EINVAL;
+	}
+
+	primitive_init(prim, start, size, pos, prefix);
+	prim->remaining = stringy->count ? stringy->count->integer : 1;
+	prim->string = stringy->token;
+	prim->nocase = stringy->nocase != NULL;
+	prim->lo = start;
+	prim->hi = prim->end;
+	prim->searches = 1;
+
+	if (stringy->scope) {
+		prim->scope_cur = pos;
+		prim->scope_left = (unsigned long long)stringy->scope->integer + 1;
+	}
+
+	len = prim->string->lexeme_len;
+
+	/* matches may start anywhere in [lo, min(pos, hi - len)] */
+	if (prim->dir < 0 && len <= (size_t)(prim->hi - prim->lo)) {
+		prim->cur = (pos < prim->hi - len ? pos : prim->hi - len) + 1;
+	}
+
+	return 0;
+}
+
+int primitive_string_found(struct primitive *prim, const char *match, const char **result)
+{
+	size_t len;
+
+	len = prim->string->lexeme_len;
+
+	if (!match) {
+		return -ENOENT;
+	}
+
+	/* occurrences don't overlap */
+	if (--prim->remaining > 0 && len) {
+		if (prim->dir > 0) {
+			prim->cur = match + len;
+		} else if ((size_t)(match - prim->lo) >= len) {
+			prim->cur = match - len + 1;
+		} else {
+			return -ENOENT;
+		}
+
+		prim->searches++;
+		return -EINPROGRESS;
+	}
+
+	prim->match = match;
+	*result = prim->prefix == TOKEN_LESS || prim->prefix == TOKEN_DGREATER ? match + len : match;
+	return 0;
+}
+
+/* counts the newlines between scope_cur and to, and ends the scope at the last one it may cross */
+static void primitive_scope(struct primitive *prim, const char *to)
+{
+	const char *newline;
+	size_t count;
+	size_t lo;
+	size_t hi;
+
+	if (prim->dir > 0 ? to <= prim->scope_cur : to >= prim->scope_cur) {
+		return;
+	}
+
+	lo = (prim->dir > 0 ? prim->scope_cur : to) - prim->start;
+	hi = (prim->dir > 0 ? to : prim->scope_cur) - prim->start;
+
+	/* a single newline is found without counting the ones after it */
+	count = prim->scope_left == 1 ? 0 : search_count_newlines(prim->start, lo, hi);
+	newline = NULL;
+
+	if (prim->scope_left == 1 || count >= prim->scope_left) {
+		newline = prim->dir > 0 ?
+			search_newline(prim->start, lo, hi, prim->scope_left) :
+			search_rnewline(prim->start, lo, hi, prim->scope_left);
+	}
+
+	if (!newline) {
+		prim->scope_left -= count;
+		prim->scope_cur = to;
+	} else if (prim->dir > 0) {
+		prim->hi = newline;
+		prim->scope_left = 0;
+	} else {
+		prim->lo = newline + 1;
+		prim->scope_left = 0;
+	}
+}
+
+int primitive_string(struct primitive *prim, size_t *budget, const char **result)
+{
+	const char *needle;
+	size_t len;
+	int err;
+
+	needle = prim->string->lexeme;
+	len = prim->string->lexeme_len;
+
+	if (!len) {
+		prim->match = prim->pos;
+		*result = prim->pos;
+		return 0;
+	}
+
+	if (len > (size_t)(prim->hi - prim->lo)) {
+		return -ENOENT;
+	}
+
+	for (;;) {
+		const char *match;
+		size_t window;
+		size_t used;
+
+		if (prim->dir > 0 ? prim->cur > prim->hi - len : prim->cur <= prim->lo) {
+			return -ENOENT;
+		}
+
+		if (!*budget) {
+			return -EINPROGRESS;
+		}
+
+		window = prim->dir > 0 ? (size_t)(prim->hi - len + 1 - prim->cur) :
+			(size_t)(prim->cur - prim->lo);
+		window = window < *budget ? window : *budget;
+
+		/*
+		 * Until the end of the scope is known, it is looked for in the part
+		 * of the text the next search would cover, which is kept small so
+		 * that it doesn't run far ahead of the search.
+		 */
+		if (prim->scope_left) {
+			window = window < LINE_WINDOW ? window : LINE_WINDOW;
+			primitive_scope(prim, prim->dir > 0 ? prim->cur + window + len - 1 :
+					prim->cur - window);
+
+			if (prim->dir > 0 ? prim->cur > prim->hi - len : prim->cur <= prim->lo) {
+				return -ENOENT;
+			}
+
+			if (prim->dir > 0 && window > (size_t)(prim->hi - len + 1 - prim->cur)) {
+				window = prim->hi - len + 1 - prim->cur;
+			} else if (prim->dir < 0 && window > (size_t)(prim->cur - prim->lo)) {
+				window = prim->cur - prim->lo;
+			}
+		}
+
+		if (prim->dir > 0) {
+			/* matches may start anywhere in [cur, hi - len] */
+			if (prim->nocase) {
+				match = search_first_nocase(prim->start, prim->cur - prim->start,
+							    prim->cur + window - prim->start,
+							    needle, len);
+			} else {
+				match = memmem(prim->cur, window + len - 1, needle, len);
+			}
+
+			used = match ? (size_t)(match + len - prim->cur) : window;
+			prim->cur += window;
+		} else {
+			if (prim->nocase) {
+				match = search_last_nocase(prim->start, prim->cur - window - prim->start,
+							   prim->cur - prim->start, needle, len);
+			} else {
+				match = search_last(prim->start, prim->cur - window - prim->start,
+						    prim->cur - prim->start, needle, len);
+			}
+
+			used = match ? (size_t)(prim->cur - match) : window;
+			prim->cur -= window;
+		}
+
+		*budget -= used < *budget ? used : *budget;
+
+		if (match && (err = primitive_string_found(prim, match, result)) != -EINPROGRESS) {
+			return err;
+		}
+	}
+}
+
+int primitive_line_init(struct primitive *prim, struct line_expr *expr, const char *start,
+			const size_t size, const char *pos, const token_type_t prefix)
+{
+	long long steps;
+
+	if (!expr->integer) {
+		return -EBADFD;
+	}
+
+	primitive_init(prim, start, size, pos, prefix);
+	steps = expr->integer->integer;
+
+	if (prefix == TOKEN_DLESS || prefix == TOKEN_DGREATER) {
+		steps++;
+	} else if (prefix == TOKEN_INVALID) {
+		/* when making absolute movements, :1 is the first line, not :0 */
+		steps--;
+	}
+
+	/* :0 never runs out of lines to cross, and stops at the end of the text */
+	prim->remaining = steps < 0 ? ULLONG_MAX : (unsigned long long)steps;
+	return 0;
+}
+
+int primitive_line(struct primitive *prim, size_t *budget, const char **result)
+{
+	while (prim->remaining) {
+		const char *newline;
+		size_t window;
+		size_t count;
+		size_t lo;
+		size_t hi;
+
+		/* when there are no more lines, the movement stops at the end of the text */
+		if (prim->dir > 0 ? prim->cur >= prim->end : prim->cur <= prim->start) {
+			*result = prim->dir > 0 ? prim->end : prim->start;
+			return 0;
+		}
+
+		if (!*budget) {
+			return -EINPROGRESS;
+		}
+
+		window = prim->dir > 0 ? prim->end - prim->cur : prim->cur - prim->start;
+		window = window < *budget ? window : *budget;
+		window = window < LINE_WINDOW ? window : LINE_WINDOW;
+
+		if (prim->dir > 0) {
+			lo = prim->cur - prim->start;
+			hi = lo + window;
+		} else {
+			hi = prim->cur - prim->start;
+			lo = hi - window;
+		}
+
+		/* a single newline is found without counting the ones after it */
+		count = prim->remaining == 1 ? 1 : search_count_newlines(prim->start, lo, hi);
+		newline = NULL;
+
+		if (count >= prim->remaining) {
+			newline = prim->dir > 0 ?
+				search_newline(prim->start, lo, hi, prim->remaining) :
+				search_rnewline(prim->start, lo, hi, prim->remaining);
+		}
+
+		if (!newline) {
+			count = prim->remaining == 1 ? 0 : count;
+			prim->remaining -= count;
+			prim->crossed += count;
+			prim->cur = prim->start + (prim->dir > 0 ? hi : lo);
+			*budget -= window;
+			continue;
+		}
+
+		prim->crossed += prim->remaining;
+		prim->remaining = 0;
+
+		if (prim->dir > 0) {
+			*budget -= newline + 1 - (prim->start + lo);
+			prim->cur = newline + 1;
+		} else {
+			*budget -= prim->start + hi - newline;
+			prim->cur = newline;
+		}
+	}
+
+	if (prim->prefix == TOKEN_DGREATER) {
+		prim->cur--;
+	} else if (prim->prefix == TOKEN_DLESS) {
+		prim->cur++;
+	}
+
+	*result = prim->cur;
+	return 0;
+}
+
+int primitive_col_init(struct primitive *prim, struct col_expr *expr, const char *start,
+		       const size_t size, const char *pos, const token_type_t prefix)
+{
+	long long steps;
+
+	if (!expr->integer) {
+		return -EBADFD;
+	}
+
+	primitive_init(prim, start, size, pos, prefix);
+	steps = expr->integer->integer;
+
+	if (steps < 0) {
+		prim->dir = -prim->dir;
+		steps = -steps;
+	}
+
+	prim->remaining = steps;
+	return 0;
+}
+
+/* columns stop at the newline that ends the line, and before the one that starts it */
+int primitive_col(struct primitive *prim, size_t *budget, const char **result)
+{
+	while (prim->remaining) {
+		const char *new_pos;
+
+		if (prim->dir > 0 ? prim->cur >= prim->end : prim->cur <= prim->start) {
+			break;
+		}
+
+		if (!*budget) {
+			return -EINPROGRESS;
+		}
+
+		(*budget)--;
+		prim->remaining--;
+		new_pos = prim->cur + prim->dir;
+
+		if (new_pos < prim->end && *new_pos == '\n') {
+			if (prim->dir > 0) {
+				prim->cur = new_pos;
+			}
+
+			break;
+		}
+
+		prim->cur = new_pos;
+	}
+
+	*result = prim->cur;
+	return 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * primitive.h - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef PRIMITIVE_H
+#define PRIMITIVE_H
+
+#include <stddef.h>
+#include "telex.h"
+#include "token.h"
+
+/*
+ * The primary expressions that scan the text: string searches, and line
+ * and column movements. They scan at most as many bytes as are left in
+ * the budget and return -EINPROGRESS if it runs out, and continue where
+ * they stopped when they are called again. eval.c runs them in pieces to
+ * check its limits in between, and resume.c runs them with the budget of
+ * each step.
+ */
+struct primitive {
+	const char *start;
+	const char *end;
+	token_type_t prefix;
+	int dir;
+
+	/* where the expression is evaluated from, and how far it got */
+	const char *pos;
+	const char *cur;
+
+	/* occurrences, newlines, or columns that are still to be crossed */
+	unsigned long long remaining;
+
+	/* strings have to lie in [lo, hi); match is the last occurrence */
+	struct token *string;
+	int nocase;
+	const char *lo;
+	const char *hi;
+	const char *match;
+	size_t searches;
+
+	/*
+	 * scoped searches have counted the newlines up to scope_cur, and the
+	 * scope ends at the scope_left-th one after it; zero once lo or hi is
+	 * known, or if the search isn't scoped
+	 */
+	const char *scope_cur;
+	unsigned long long scope_left;
+
+	/* newlines that line movements crossed */
+	size_t crossed;
+};
+
+int primitive_string_init(struct primitive *prim, struct stringy *stringy, const char *start,
+			  const size_t size, const char *pos, const token_type_t prefix);
+int primitive_string(struct primitive *prim, size_t *budget, const char **result);
+/* for searches that use an index; the next one starts at primitive_string_from() */
+int primitive_string_found(struct primitive *prim, const char *match, const char **result);
+
+int primitive_line_init(struct primitive *prim, struct line_expr *expr, const char *start,
+			const size_t size, const char *pos, const token_type_t prefix);
+int primitive_line(struct primitive *prim, size_t *budget, const char **result);
+
+int primitive_col_init(struct primitive *prim, struct col_expr *expr, const char *start,
+		       const size_t size, const char *pos, const token_type_t prefix);
+int primitive_col(struct primitive *prim, size_t *budget, const char **result);
+
+static inline const char* primitive_string_from(const struct primitive *prim)
+{
+	/* backward, cur is one past the last place a match may start at */
+	return prim->dir > 0 ? prim->cur : prim->cur - 1;
+}
+
+#endif /* PRIMITIVE_H */
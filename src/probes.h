@@ -0,0 +1,93 @@
+/*
+ * probes.h - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef PROBES_H
+#define PROBES_H
+
+/*
+ * USDT probes for the libtelex provider. They are compiled out if
+ * <sys/sdt.h> is not available, or if TELEX_NO_PROBES is defined. Every
+ * probe has a semaphore that tracers increment while they are attached,
+ * and the arguments of a probe are only computed while its semaphore is
+ * set, so an unused probe costs a load and a branch.
+ *
+ *   parse__start(input)                  parse__done(input, err)
+ *   tokenize__start(input)               tokenize__done(input, num_tokens, err)
+ *   eval__start(telex, offset, size)     eval__done(telex, offset, result, err)
+ *   primary__start(kind, offset, prefix) primary__done(kind, offset, result, err)
+ *
+ * Offsets and results are relative to the start of the text, and results
+ * are -1 if the lookup failed.
+ */
+
+#if !defined(TELEX_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#define TELEX_HAVE_PROBES 1
+#endif
+#endif
+
+#ifdef TELEX_HAVE_PROBES
+/* the names that <sys/sdt.h> expects; they are defined in probes.c */
+#define PROBE_SEMAPHORE(name)       libtelex_##name##_semaphore
+#define PROBE_ENABLED(name)         __builtin_expect(PROBE_SEMAPHORE(name), 0)
+
+#define PROBE1(name, a) do {						\
+		if (PROBE_ENABLED(name))				\
+			DTRACE_PROBE1(libtelex, name, a);		\
+	} while (0)
+#define PROBE2(name, a, b) do {						\
+		if (PROBE_ENABLED(name))				\
+			DTRACE_PROBE2(libtelex, name, a, b);		\
+	} while (0)
+#define PROBE3(name, a, b, c) do {					\
+		if (PROBE_ENABLED(name))				\
+			DTRACE_PROBE3(libtelex, name, a, b, c);		\
+	} while (0)
+#define PROBE4(name, a, b, c, d) do {					\
+		if (PROBE_ENABLED(name))				\
+			DTRACE_PROBE4(libtelex, name, a, b, c, d);	\
+	} while (0)
+
+extern volatile unsigned short PROBE_SEMAPHORE(parse__start);
+extern volatile unsigned short PROBE_SEMAPHORE(parse__done);
+extern volatile unsigned short PROBE_SEMAPHORE(tokenize__start);
+extern volatile unsigned short PROBE_SEMAPHORE(tokenize__done);
+extern volatile unsigned short PROBE_SEMAPHORE(eval__start);
+extern volatile unsigned short PROBE_SEMAPHORE(eval__done);
+extern volatile unsigned short PROBE_SEMAPHORE(primary__start);
+extern volatile unsigned short PROBE_SEMAPHORE(primary__done);
+#else
+#define PROBE_ENABLED(name)         0
+#define PROBE1(name, a)             do { } while (0)
+#define PROBE2(name, a, b)          do { } while (0)
+#define PROBE3(name, a, b, c)       do { } while (0)
+#define PROBE4(name, a, b, c, d)    do { } while (0)
+#endif
+
+/* the kinds of primary expressions in primary__start and primary__done */
+#define PROBE_PRIMARY_STRING 1
+#define PROBE_PRIMARY_REGEX  2
+#define PROBE_PRIMARY_LINE   3
+#define PROBE_PRIMARY_COL    4
+#define PROBE_PRIMARY_TELEX  5
+
+#endif /* PROBES_H */
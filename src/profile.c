@@ -0,0 +1,427 @@
+/*
+ * profile.c - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "profile.h"
+#include "telex.h"
+#include "eval.h"
+#include "stats.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+
+#define PROFILE_UNIT "cycles"
+
+static uint64_t profile_clock(void)
+{
+	return __rdtsc();
+}
+#else
+#define PROFILE_UNIT "ns"
+
+static uint64_t profile_clock(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+#endif
+
+/*
+ * Every compound step and every alternative of the telex, including the
+ * ones in nested telexes, has a node. Nodes are found by the address of
+ * the expression they belong to.
+ */
+
+struct profile_node {
+	const void *expr;
+	size_t calls;
+	size_t failed;
+	uint64_t clock;
+	size_t bytes;
+};
+
+struct telex_profile {
+	struct telex *telex;
+	size_t lookups;
+
+	struct profile_node *nodes;
+	size_t num_nodes;
+
+	/* indices into nodes, plus one, so that zero is an empty slot */
+	size_t *slots;
+	size_t num_slots;
+};
+
+struct profile_dump {
+	char *str;
+	size_t str_size;
+	int total;
+};
+
+static size_t slot_of(const struct telex_profile *profile, const void *expr)
+{
+	uint64_t hash;
+
+	hash = (uint64_t)(uintptr_t)expr * 0x9e3779b97f4a7c15ULL;
+	return (size_t)(hash >> 32) & (profile->num_slots - 1);
+}
+
+static struct profile_node* profile_find(struct telex_profile *profile, const void *expr)
+{
+	size_t slot;
+
+	for (slot = slot_of(profile, expr); profile->slots[slot];
+	     slot = (slot + 1) & (profile->num_slots - 1)) {
+		struct profile_node *node;
+
+		node = &profile->nodes[profile->slots[slot] - 1];
+
+		if (node->expr == expr) {
+			return node;
+		}
+	}
+
+	return NULL;
+}
+
+static int profile_add(struct telex_profile *profile, const void *expr, size_t *capacity)
+{
+	if (profile->num_nodes == *capacity) {
+		struct profile_node *nodes;
+		size_t new_capacity;
+
+		new_capacity = *capacity ? *capacity * 2 : 16;
+
+		if (!(nodes = realloc(profile->nodes, new_capacity * sizeof(*nodes)))) {
+			return -ENOMEM;
+		}
+
+		profile->nodes = nodes;
+		*capacity = new_capacity;
+	}
+
+	memset(&profile->nodes[profile->num_nodes], 0, sizeof(*profile->nodes));
+	profile->nodes[profile->num_nodes++].expr = expr;
+
+	return 0;
+}
+
+static int profile_add_steps(struct telex_profile *profile, struct compound_expr *expr,
+			     size_t *capacity)
+{
+	struct compound_expr *step;
+	int err;
+
+	for (step = expr; step; step = step->compound_expr) {
+		struct or_expr *alternative;
+
+		if ((err = profile_add(profile, step, capacity)) < 0) {
+			return err;
+		}
+
+		for (alternative = step->or_expr; alternative; alternative = alternative->or_expr) {
+			struct telex *nested;
+
+			if ((err = profile_add(profile, alternative, capacity)) < 0) {
+				return err;
+			}
+
+			nested = alternative->primary_expr ? alternative->primary_expr->telex : NULL;
+
+			if (nested &&
+			    (err = profile_add_steps(profile, nested->compound_expr, capacity)) < 0) {
+				return err;
+			}
+		}
+	}
+
+	return 0;
+}
+
+int telex_profile_new(struct telex_profile **profile, struct telex *telex)
+{
+	struct telex_profile *new;
+	size_t capacity;
+	size_t i;
+	int err;
+
+	if (!profile || !telex) {
+		return -EINVAL;
+	}
+
+	if (!(new = calloc(1, sizeof(*new)))) {
+		return -ENOMEM;
+	}
+
+	new->telex = telex;
+	capacity = 0;
+
+	if ((err = profile_add_steps(new, telex->compound_expr, &capacity)) < 0) {
+		goto cleanup;
+	}
+
+	for (new->num_slots = 16; new->num_slots < new->num_nodes * 2; new->num_slots *= 2);
+
+	if (!(new->slots = calloc(new->num_slots, sizeof(*new->slots)))) {
+		err = -ENOMEM;
+		goto cleanup;
+	}
+
+	for (i = 0; i < new->num_nodes; i++) {
+		size_t slot;
+
+		for (slot = slot_of(new, new->nodes[i].expr); new->slots[slot];
+		     slot = (slot + 1) & (new->num_slots - 1));
+
+		new->slots[slot] = i + 1;
+	}
+
+	*profile = new;
+	return 0;
+
+cleanup:
+	telex_profile_free(&new);
+	return err;
+}
+
+void telex_profile_free(struct telex_profile **profile)
+{
+	if (profile && *profile) {
+		free((*profile)->slots);
+		free((*profile)->nodes);
+		free(*profile);
+		*profile = NULL;
+	}
+}
+
+void telex_profile_reset(struct telex_profile *profile)
+{
+	size_t i;
+
+	if (!profile) {
+		return;
+	}
+
+	profile->lookups = 0;
+
+	for (i = 0; i < profile->num_nodes; i++) {
+		const void *expr;
+
+		expr = profile->nodes[i].expr;
+		memset(&profile->nodes[i], 0, sizeof(profile->nodes[i]));
+		profile->nodes[i].expr = expr;
+	}
+}
+
+const char* telex_profile_lookup(struct telex_profile *profile, const char *start,
+				 const size_t size, const char *pos)
+{
+	struct telex_stats stats;
+	struct eval_context ctx;
+	const char *result;
+	token_type_t prefix;
+	int err;
+
+	if (!profile || !start) {
+		return NULL;
+	}
+
+	/* the bytes of a node are taken from the statistics */
+	eval_context_init(&ctx, start, size, NULL);
+	stats_start(&ctx, &stats, NULL);
+	ctx.profile = profile;
+	result = NULL;
+	prefix = profile->telex->prefix ? profile->telex->prefix->type : TOKEN_INVALID;
+
+	err = eval_telex(profile->telex, &ctx, pos, prefix, &result);
+	stats_finish(&ctx);
+	profile->lookups++;
+
+	return err < 0 ? NULL : result;
+}
+
+void profile_enter(struct eval_context *ctx, struct profile_mark *mark)
+{
+	mark->bytes = ctx->stats->bytes_scanned;
+	mark->clock = profile_clock();
+}
+
+void profile_leave(struct eval_context *ctx, const void *expr,
+		   const struct profile_mark *mark, const int err)
+{
+	struct profile_node *node;
+	uint64_t clock;
+
+	clock = profile_clock();
+
+	if (!(node = profile_find(ctx->profile, expr))) {
+		return;
+	}
+
+	node->calls++;
+	node->failed += err < 0;
+	node->clock += clock - mark->clock;
+	node->bytes += ctx->stats->bytes_scanned - mark->bytes;
+}
+
+static char* dump_at(struct profile_dump *dump)
+{
+	return (size_t)dump->total < dump->str_size ? dump->str + dump->total :
+		dump->str + dump->str_size;
+}
+
+static size_t dump_left(struct profile_dump *dump)
+{
+	return (size_t)dump->total < dump->str_size ? dump->str_size - dump->total : 0;
+}
+
+static void dump_printf(struct profile_dump *dump, const char *format, ...)
+{
+	va_list args;
+	int written;
+
+	va_start(args, format);
+	written = vsnprintf(dump_at(dump), dump_left(dump), format, args);
+	va_end(args);
+
+	if (written > 0) {
+		dump->total += written;
+	}
+}
+
+static void dump_node(struct profile_dump *dump, struct telex_profile *profile,
+		      const void *expr, const int depth)
+{
+	struct profile_node *node;
+
+	if (!(node = profile_find(profile, expr))) {
+		return;
+	}
+
+	dump_printf(dump, "%8zu %8zu %14llu %14zu  %*s", node->calls, node->failed,
+		    (unsigned long long)(node->calls ? node->clock / node->calls : 0),
+		    node->calls ? node->bytes / node->calls : 0, depth * 2, "");
+}
+
+static void dump_written(struct profile_dump *dump, const int written)
+{
+	if (written > 0) {
+		dump->total += written;
+	}
+}
+
+static int dump_steps(struct profile_dump *dump, struct telex_profile *profile,
+		      struct telex *telex, const int depth);
+
+static int dump_alternatives(struct profile_dump *dump, struct telex_profile *profile,
+			     struct or_expr *alternative, const int depth)
+{
+	int err;
+
+	/* the chain is left-recursive, so the first alternative is at the bottom */
+	if (alternative->or_expr &&
+	    (err = dump_alternatives(dump, profile, alternative->or_expr, depth)) < 0) {
+		return err;
+	}
+
+	dump_node(dump, profile, alternative, depth);
+	dump_written(dump, primary_expr_to_string(alternative->primary_expr,
+						  dump_at(dump), dump_left(dump)));
+	dump_printf(dump, "\n");
+
+	if (alternative->primary_expr->telex) {
+		return dump_steps(dump, profile, alternative->primary_expr->telex, depth + 1);
+	}
+
+	return 0;
+}
+
+static int dump_steps(struct profile_dump *dump, struct telex_profile *profile,
+		      struct telex *telex, const int depth)
+{
+	struct compound_expr **steps;
+	int num_steps;
+	int err;
+	int i;
+
+	if ((num_steps = compound_expr_flatten(telex->compound_expr, &steps)) < 0) {
+		return num_steps;
+	}
+
+	for (err = 0, i = 0; i < num_steps && err >= 0; i++) {
+		struct or_expr *alternatives;
+
+		alternatives = steps[i]->or_expr;
+		dump_node(dump, profile, steps[i], depth);
+
+		if (i == 0 && telex->prefix) {
+			dump_written(dump, token_to_string(telex->prefix, dump_at(dump),
+							   dump_left(dump)));
+		}
+
+		if (steps[i]->prefix) {
+			dump_written(dump, token_to_string(steps[i]->prefix, dump_at(dump),
+							   dump_left(dump)));
+		}
+
+		dump_written(dump, or_expr_to_string(alternatives, dump_at(dump), dump_left(dump)));
+		dump_printf(dump, "\n");
+
+		if (alternatives->or_expr) {
+			err = dump_alternatives(dump, profile, alternatives, depth + 1);
+		} else if (alternatives->primary_expr->telex) {
+			err = dump_steps(dump, profile, alternatives->primary_expr->telex, depth + 1);
+		}
+	}
+
+	free(steps);
+	return err;
+}
+
+int telex_profile_to_string(struct telex_profile *profile, char *str, const size_t str_size)
+{
+	struct profile_dump dump;
+	int err;
+
+	if (!profile || (!str && str_size)) {
+		return -EINVAL;
+	}
+
+	dump.str = str;
+	dump.str_size = str_size;
+	dump.total = 0;
+
+	dump_printf(&dump, "%zu lookups\n%8s %8s %14s %14s  %s\n", profile->lookups,
+		    "calls", "failed", PROFILE_UNIT "/call", "bytes/call", "step");
+
+	if ((err = dump_steps(&dump, profile, profile->telex, 0)) < 0) {
+		return err;
+	}
+
+	return dump.total;
+}
@@ -0,0 +1,38 @@
+/*
+ * profile.h - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <telex/profile.h>
+#include <stdint.h>
+
+struct eval_context;
+
+struct profile_mark {
+	uint64_t clock;
+	size_t bytes;
+};
+
+void profile_enter(struct eval_context *ctx, struct profile_mark *mark);
+void profile_leave(struct eval_context *ctx, const void *node,
+		   const struct profile_mark *mark, const int err);
+
+#endif /* PROFILE_H */
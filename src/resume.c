@@ -0,0 +1,400 @@
+/*
+ * resume.c - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <telex/resume.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "telex.h"
+#include "primitive.h"
+
+/*
+ * This evaluates telexes the same way as the eval_* functions, but instead
+ * of recursing, it keeps a stack of frames, one for each expression that
+ * is being evaluated. Searches and movements are the primitives that the
+ * eval_* functions use, and are run with the budget that is left, so they
+ * continue where they stopped in the next step. When a frame is done, it
+ * leaves its error code and result in the evaluation and is popped, and
+ * the frame below it continues.
+ */
+
+typedef enum {
+	FRAME_COMPOUND = 0,
+	FRAME_OR,
+	FRAME_STRING,
+	FRAME_LINE,
+	FRAME_COL
+} frame_type_t;
+
+struct eval_frame {
+	frame_type_t type;
+	token_type_t prefix;
+	const char *pos;
+	const char *cur;
+
+	union {
+		struct compound_expr *compound_expr;
+		struct or_expr *or_expr;
+	} expr;
+
+	/* steps evaluated by compound frames, and alternatives tried by or frames */
+	int stage;
+	int num_steps;
+
+	/* strings, lines, and columns */
+	struct primitive prim;
+};
+
+struct telex_eval {
+	const char *start;
+	size_t size;
+
+	struct eval_frame *frames;
+	int num_frames;
+	int max_frames;
+
+	/* the outcome of the frame that was popped last */
+	int err;
+	const char *result;
+};
+
+static struct eval_frame* frame_push(struct telex_eval *eval, const frame_type_t type,
+				     const token_type_t prefix, const char *pos)
+{
+	struct eval_frame *frame;
+
+	if (eval->num_frames == eval->max_frames) {
+		struct eval_frame *frames;
+		int max_frames;
+
+		max_frames = eval->max_frames ? eval->max_frames * 2 : 8;
+
+		if (!(frames = realloc(eval->frames, max_frames * sizeof(*frames)))) {
+			return NULL;
+		}
+
+		eval->frames = frames;
+		eval->max_frames = max_frames;
+	}
+
+	frame = &eval->frames[eval->num_frames++];
+	memset(frame, 0, sizeof(*frame));
+	frame->type = type;
+	frame->prefix = prefix;
+	frame->pos = pos;
+	frame->cur = pos;
+
+	return frame;
+}
+
+static void frame_pop(struct telex_eval *eval, const int err, const char *result)
+{
+	eval->num_frames--;
+	eval->err = err;
+	eval->result = err < 0 ? NULL : result;
+}
+
+static int push_compound(struct telex_eval *eval, struct compound_expr *expr,
+			 const token_type_t prefix, const char *pos)
+{
+	struct compound_expr *cur;
+	struct eval_frame *frame;
+
+	if (!(frame = frame_push(eval, FRAME_COMPOUND, prefix, pos))) {
+		return -ENOMEM;
+	}
+
+	frame->expr.compound_expr = expr;
+
+	for (cur = expr; cur; cur = cur->compound_expr) {
+		frame->num_steps++;
+	}
+
+	return 0;
+}
+
+static int push_primary(struct telex_eval *eval, struct primary_expr *expr,
+			const token_type_t prefix, const char *pos)
+{
+	struct eval_frame *frame;
+	struct primitive prim;
+	frame_type_t type;
+	int err;
+
+	if (!expr) {
+		frame_pop(eval, -EINVAL, NULL);
+		return 0;
+	}
+
+	if (expr->stringy) {
+		if (expr->stringy->token->type != TOKEN_STRING) {
+			frame_pop(eval, expr->stringy->token->type == TOKEN_REGEX ?
+				  -ENOSYS : -EBADFD, NULL);
+			return 0;
+		}
+
+		type = FRAME_STRING;
+		err = primitive_string_init(&prim, expr->stringy, eval->start, eval->size, pos, prefix);
+	} else if (expr->line_expr) {
+		type = FRAME_LINE;
+		err = primitive_line_init(&prim, expr->line_expr, eval->start, eval->size, pos, prefix);
+	} else if (expr->col_expr) {
+		type = FRAME_COL;
+		err = primitive_col_init(&prim, expr->col_expr, eval->start, eval->size, pos, prefix);
+	} else if (expr->telex) {
+		struct telex *telex;
+
+		telex = expr->telex;
+		return push_compound(eval, telex->compound_expr,
+				     telex->prefix ? telex->prefix->type : prefix, pos);
+	} else {
+		err = -EBADFD;
+	}
+
+	if (err < 0) {
+		frame_pop(eval, err, NULL);
+		return 0;
+	}
+
+	if (!(frame = frame_push(eval, type, prefix, pos))) {
+		return -ENOMEM;
+	}
+
+	frame->prim = prim;
+	return 0;
+}
+
+static int step_compound(struct telex_eval *eval, struct eval_frame *frame)
+{
+	struct compound_expr *step;
+	token_type_t prefix;
+	const char *pos;
+	int i;
+
+	if (!frame->expr.compound_expr) {
+		frame_pop(eval, -EINVAL, NULL);
+		return 0;
+	}
+
+	if (frame->stage > 0) {
+		if (eval->err < 0) {
+			frame_pop(eval, eval->err, NULL);
+			return 0;
+		}
+
+		frame->cur = eval->result;
+	}
+
+	if (frame->stage == frame->num_steps) {
+		frame_pop(eval, 0, frame->cur);
+		return 0;
+	}
+
+	/* the chain is left-recursive, so the first step is at the bottom */
+	for (i = frame->num_steps - 1, step = frame->expr.compound_expr; i > frame->stage; i--) {
+		step = step->compound_expr;
+	}
+
+	prefix = step->prefix ? step->prefix->type : frame->prefix;
+	pos = frame->cur;
+	frame->stage++;
+
+	/* pushing may move the frames, so frame must not be used after this */
+	if (!(frame = frame_push(eval, FRAME_OR, prefix, pos))) {
+		return -ENOMEM;
+	}
+
+	frame->expr.or_expr = step->or_expr;
+	return 0;
+}
+
+static int step_or(struct telex_eval *eval, struct eval_frame *frame)
+{
+	struct or_expr *expr;
+	token_type_t prefix;
+	const char *pos;
+
+	expr = frame->expr.or_expr;
+	prefix = frame->prefix;
+	pos = frame->pos;
+
+	if (!expr) {
+		frame_pop(eval, -EINVAL, NULL);
+		return 0;
+	}
+
+	switch (frame->stage) {
+	case 0:
+		/* the alternatives after the first one are tried first, like in eval_or_expr() */
+		if (expr->or_expr) {
+			frame->stage = 1;
+
+			if (!(frame = frame_push(eval, FRAME_OR, prefix, pos))) {
+				return -ENOMEM;
+			}
+
+			frame->expr.or_expr = expr->or_expr;
+			return 0;
+		}
+
+		/* fall through */
+
+	case 1:
+		if (frame->stage == 1 && eval->err >= 0) {
+			frame_pop(eval, 0, eval->result);
+			return 0;
+		}
+
+		frame->stage = 2;
+		return push_primary(eval, expr->primary_expr, prefix, pos);
+
+	default:
+		/* the primary expression's outcome is the outcome of this frame */
+		frame_pop(eval, eval->err, eval->result);
+		return 0;
+	}
+}
+
+static void step_primitive(struct telex_eval *eval, struct eval_frame *frame,
+			   int (*step)(struct primitive*, size_t*, const char**), size_t *budget)
+{
+	const char *result;
+	int err;
+
+	result = NULL;
+
+	/* the frame stays until the primitive is done */
+	if ((err = step(&frame->prim, budget, &result)) != -EINPROGRESS) {
+		frame_pop(eval, err, result);
+	}
+}
+
+int telex_eval_start(struct telex_eval **eval, struct telex *telex,
+		     const char *start, const size_t size, const char *pos)
+{
+	struct telex_eval *new;
+	int err;
+
+	if (!eval || !telex || !start) {
+		return -EINVAL;
+	}
+
+	if (telex->prefix && !pos) {
+		return -EBADMSG;
+	}
+
+	if (!(new = calloc(1, sizeof(*new)))) {
+		return -ENOMEM;
+	}
+
+	new->start = start;
+	new->size = size;
+
+	if ((err = push_compound(new, telex->compound_expr,
+				 telex->prefix ? telex->prefix->type : TOKEN_INVALID,
+				 pos ? pos : start)) < 0) {
+		telex_eval_free(&new);
+		return err;
+	}
+
+	*eval = new;
+	return 0;
+}
+
+telex_eval_status_t telex_eval_step(struct telex_eval *eval, const size_t budget_bytes)
+{
+	size_t budget;
+
+	if (!eval) {
+		return TELEX_EVAL_ERROR;
+	}
+
+	/* every step makes progress, even without a budget */
+	budget = budget_bytes ? budget_bytes : 1;
+
+	while (eval->num_frames > 0 && budget > 0) {
+		struct eval_frame *frame;
+		int err;
+
+		frame = &eval->frames[eval->num_frames - 1];
+		err = 0;
+
+		switch (frame->type) {
+		case FRAME_COMPOUND:
+			err = step_compound(eval, frame);
+			break;
+
+		case FRAME_OR:
+			err = step_or(eval, frame);
+			break;
+
+		case FRAME_STRING:
+			step_primitive(eval, frame, primitive_string, &budget);
+			break;
+
+		case FRAME_LINE:
+			step_primitive(eval, frame, primitive_line, &budget);
+			break;
+
+		case FRAME_COL:
+			step_primitive(eval, frame, primitive_col, &budget);
+			break;
+		}
+
+		if (err < 0) {
+			eval->num_frames = 0;
+			eval->err = err;
+			eval->result = NULL;
+		}
+	}
+
+	if (eval->num_frames > 0) {
+		return TELEX_EVAL_IN_PROGRESS;
+	}
+
+	return eval->err < 0 ? TELEX_EVAL_ERROR : TELEX_EVAL_DONE;
+}
+
+int telex_eval_result(struct telex_eval *eval, const char **result)
+{
+	if (!eval || !result) {
+		return -EINVAL;
+	}
+
+	if (eval->num_frames > 0) {
+		return -EINPROGRESS;
+	}
+
+	if (eval->err < 0) {
+		return eval->err;
+	}
+
+	*result = eval->result;
+	return 0;
+}
+
+void telex_eval_free(struct telex_eval **eval)
+{
+	if (eval && *eval) {
+		free((*eval)->frames);
+		free(*eval);
+		*eval = NULL;
+	}
+}
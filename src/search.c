@@ -0,0 +1,419 @@
+/*
+ * search.c - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "search.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * The searches below compare the needle at every candidate they find,
+ * which is fast unless the text keeps almost matching the needle, as a
+ * run of "aaaa" does for "aab". Every comparison is charged the length of
+ * the needle, and once a search has been charged more than SEARCH_MAX_WORK
+ * times the bytes it went past, it continues with search_kmp(), which
+ * looks at every byte of the text once.
+ */
+#define SEARCH_MAX_WORK 8
+
+/* letters only differ from their other case in bit 5 */
+static inline unsigned char case_bit(const unsigned char chr)
+{
+	return (unsigned char)((chr | 0x20) - 'a') < 26 ? 0x20 : 0;
+}
+
+static inline unsigned char fold(const unsigned char chr)
+{
+	return chr | case_bit(chr);
+}
+
+static int equal_nocase(const char *a, const char *b, const size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if (fold(a[i]) != fold(b[i])) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static inline int search_overworked(size_t *work, const size_t passed, const size_t len)
+{
+	*work += len;
+	return *work > SEARCH_MAX_WORK * (passed + len);
+}
+
+/*
+ * First (or last) match that starts in text[lo, hi), found with the
+ * Knuth-Morris-Pratt algorithm. Backward searches match the reversed
+ * needle against the text from its end.
+ */
+static const char* search_kmp(const char *text, const size_t lo, const size_t hi,
+			      const char *needle, const size_t len, const int backward,
+			      const int nocase)
+{
+	unsigned char *pattern;
+	const char *match;
+	size_t *border;
+	size_t end;
+	size_t i;
+	size_t k;
+
+	if (hi <= lo) {
+		return NULL;
+	}
+
+	if (!(border = malloc(len * (sizeof(*border) + 1)))) {
+		/* slow, but still correct */
+		for (i = 0; i < hi - lo; i++) {
+			k = backward ? hi - 1 - i : lo + i;
+
+			if (nocase ? equal_nocase(text + k, needle, len) :
+			    !memcmp(text + k, needle, len)) {
+				return text + k;
+			}
+		}
+
+		return NULL;
+	}
+
+	pattern = (unsigned char*)(border + len);
+
+	for (i = 0; i < len; i++) {
+		pattern[i] = needle[backward ? len - 1 - i : i];
+		pattern[i] = nocase ? fold(pattern[i]) : pattern[i];
+	}
+
+	/* border[i] is the length of the longest proper border of pattern[0, i] */
+	border[0] = 0;
+
+	for (i = 1, k = 0; i < len; i++) {
+		while (k > 0 && pattern[i] != pattern[k]) {
+			k = border[k - 1];
+		}
+
+		k += pattern[i] == pattern[k];
+		border[i] = k;
+	}
+
+	/* matches that start in [lo, hi) end in [lo + len, hi + len) */
+	end = hi + len - 1;
+	match = NULL;
+
+	for (i = 0, k = 0; i < end - lo; i++) {
+		unsigned char chr;
+
+		chr = text[backward ? end - 1 - i : lo + i];
+		chr = nocase ? fold(chr) : chr;
+
+		while (k > 0 && chr != pattern[k]) {
+			k = border[k - 1];
+		}
+
+		if (chr == pattern[k] && ++k == len) {
+			match = backward ? text + end - 1 - i : text + lo + i + 1 - len;
+			break;
+		}
+	}
+
+	free(border);
+	return match;
+}
+
+/* last match that starts in text[lo, hi) */
+const char* search_last(const char *text, size_t lo, size_t hi,
+			const char *needle, const size_t len)
+{
+	size_t start;
+	size_t work;
+
+	start = hi;
+	work = 0;
+
+	while (hi > lo) {
+		const char *candidate;
+
+		if (!(candidate = memrchr(text + lo, needle[0], hi - lo))) {
+			break;
+		}
+
+		if (memcmp(candidate, needle, len) == 0) {
+			return candidate;
+		}
+
+		hi = candidate - text;
+
+		if (search_overworked(&work, start - hi, len)) {
+			return search_kmp(text, lo, hi, needle, len, 1, 0);
+		}
+	}
+
+	return NULL;
+}
+
+#ifdef __SSE2__
+/*
+ * Candidates are the positions where the first and the last character of
+ * the needle match, after setting the case bit in the text if they are
+ * letters. That also turns some punctuation into letters, but those
+ * candidates are weeded out by equal_nocase().
+ */
+struct nocase_filter {
+	__m128i first;
+	__m128i last;
+	__m128i first_bit;
+	__m128i last_bit;
+};
+
+static void nocase_filter_init(struct nocase_filter *filter, const char *needle, const size_t len)
+{
+	filter->first = _mm_set1_epi8(fold(needle[0]));
+	filter->last = _mm_set1_epi8(fold(needle[len - 1]));
+	filter->first_bit = _mm_set1_epi8(case_bit(needle[0]));
+	filter->last_bit = _mm_set1_epi8(case_bit(needle[len - 1]));
+}
+
+/* a bit for every candidate that starts in text[at, at + 16) */
+static inline int nocase_candidates(const struct nocase_filter *filter, const char *text,
+				    const size_t at, const size_t len)
+{
+	__m128i head;
+	__m128i tail;
+
+	head = _mm_loadu_si128((const __m128i*)(text + at));
+	tail = _mm_loadu_si128((const __m128i*)(text + at + len - 1));
+
+	head = _mm_cmpeq_epi8(_mm_or_si128(head, filter->first_bit), filter->first);
+	tail = _mm_cmpeq_epi8(_mm_or_si128(tail, filter->last_bit), filter->last);
+
+	return _mm_movemask_epi8(_mm_and_si128(head, tail));
+}
+#endif
+
+/* first match that starts in text[lo, hi), ignoring the case of ASCII letters */
+const char* search_first_nocase(const char *text, size_t lo, const size_t hi,
+				const char *needle, const size_t len)
+{
+#ifdef __SSE2__
+	struct nocase_filter filter;
+#endif
+	size_t start;
+	size_t work;
+
+	start = lo;
+	work = 0;
+
+#ifdef __SSE2__
+	nocase_filter_init(&filter, needle, len);
+
+	/* four vectors at a time, since candidates are rare */
+	for (; lo + 4 * sizeof(__m128i) <= hi; lo += 4 * sizeof(__m128i)) {
+		uint64_t mask;
+
+		mask = (uint64_t)nocase_candidates(&filter, text, lo, len) |
+			(uint64_t)nocase_candidates(&filter, text, lo + 16, len) << 16 |
+			(uint64_t)nocase_candidates(&filter, text, lo + 32, len) << 32 |
+			(uint64_t)nocase_candidates(&filter, text, lo + 48, len) << 48;
+
+		while (mask) {
+			size_t at;
+
+			at = lo + __builtin_ctzll(mask);
+
+			if (equal_nocase(text + at, needle, len)) {
+				return text + at;
+			}
+
+			if (search_overworked(&work, at - start, len)) {
+				return search_kmp(text, at + 1, hi, needle, len, 0, 1);
+			}
+
+			mask &= mask - 1;
+		}
+	}
+#endif
+
+	for (; lo < hi; lo++) {
+		if (fold(text[lo]) != fold(needle[0])) {
+			continue;
+		}
+
+		if (equal_nocase(text + lo, needle, len)) {
+			return text + lo;
+		}
+
+		if (search_overworked(&work, lo - start, len)) {
+			return search_kmp(text, lo + 1, hi, needle, len, 0, 1);
+		}
+	}
+
+	return NULL;
+}
+
+/* last match that starts in text[lo, hi), ignoring the case of ASCII letters */
+const char* search_last_nocase(const char *text, const size_t lo, size_t hi,
+			       const char *needle, const size_t len)
+{
+#ifdef __SSE2__
+	struct nocase_filter filter;
+#endif
+	size_t start;
+	size_t work;
+
+	start = hi;
+	work = 0;
+
+#ifdef __SSE2__
+	nocase_filter_init(&filter, needle, len);
+
+	for (; hi - lo >= 4 * sizeof(__m128i); hi -= 4 * sizeof(__m128i)) {
+		uint64_t mask;
+		size_t at;
+
+		at = hi - 4 * sizeof(__m128i);
+		mask = (uint64_t)nocase_candidates(&filter, text, at, len) |
+			(uint64_t)nocase_candidates(&filter, text, at + 16, len) << 16 |
+			(uint64_t)nocase_candidates(&filter, text, at + 32, len) << 32 |
+			(uint64_t)nocase_candidates(&filter, text, at + 48, len) << 48;
+
+		while (mask) {
+			int bit;
+
+			bit = 63 - __builtin_clzll(mask);
+
+			if (equal_nocase(text + at + bit, needle, len)) {
+				return text + at + bit;
+			}
+
+			if (search_overworked(&work, start - at - bit, len)) {
+				return search_kmp(text, lo, at + bit, needle, len, 1, 1);
+			}
+
+			mask &= ~(1ULL << bit);
+		}
+	}
+#endif
+
+	while (hi > lo) {
+		hi--;
+
+		if (fold(text[hi]) != fold(needle[0])) {
+			continue;
+		}
+
+		if (equal_nocase(text + hi, needle, len)) {
+			return text + hi;
+		}
+
+		if (search_overworked(&work, start - hi, len)) {
+			return search_kmp(text, lo, hi, needle, len, 1, 1);
+		}
+	}
+
+	return NULL;
+}
+
+size_t search_count_newlines(const char *text, const size_t lo, const size_t hi)
+{
+	const uint64_t ones = 0x0101010101010101ULL;
+	const uint64_t highs = 0x8080808080808080ULL;
+	size_t count;
+	size_t i;
+
+	count = 0;
+	i = lo;
+
+#ifdef __SSE2__
+	/* sixteen bytes at a time; each newline subtracts -1 from its byte counter */
+	while (i + sizeof(__m128i) <= hi) {
+		__m128i counts;
+		int round;
+
+		counts = _mm_setzero_si128();
+
+		/* the byte counters would overflow after 255 rounds */
+		for (round = 0; round < 255 && i + sizeof(__m128i) <= hi;
+		     round++, i += sizeof(__m128i)) {
+			__m128i chunk;
+
+			chunk = _mm_loadu_si128((const __m128i*)(text + i));
+			counts = _mm_sub_epi8(counts, _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n')));
+		}
+
+		counts = _mm_sad_epu8(counts, _mm_setzero_si128());
+		count += _mm_cvtsi128_si32(counts) + _mm_extract_epi16(counts, 4);
+	}
+#endif
+
+	/* eight bytes at a time; the high bit of each byte that is a newline gets set */
+	for (; i + sizeof(uint64_t) <= hi; i += sizeof(uint64_t)) {
+		uint64_t word;
+
+		memcpy(&word, text + i, sizeof(word));
+		word ^= ones * '\n';
+		word = ~(((word & ~highs) + ~highs) | word) & highs;
+		count += ((word >> 7) * ones) >> 56;
+	}
+
+	for (; i < hi; i++) {
+		count += text[i] == '\n';
+	}
+
+	return count;
+}
+
+/* the count-th newline in text[lo, hi) */
+const char* search_newline(const char *text, const size_t lo, const size_t hi,
+			   size_t count)
+{
+	const char *pos;
+
+	for (pos = text + lo; (pos = memchr(pos, '\n', text + hi - pos)); pos++) {
+		if (!--count) {
+			return pos;
+		}
+	}
+
+	return NULL;
+}
+
+/* the count-th newline in text[lo, hi), counting backwards */
+const char* search_rnewline(const char *text, const size_t lo, const size_t hi,
+			    size_t count)
+{
+	const char *pos;
+
+	for (pos = text + hi; pos > text + lo &&
+		     (pos = memrchr(text + lo, '\n', pos - text - lo)); ) {
+		if (!--count) {
+			return pos;
+		}
+	}
+
+	return NULL;
+}
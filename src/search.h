@@ -0,0 +1,39 @@
+/*
+ * search.h - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stddef.h>
+
+const char* search_last(const char *text, size_t lo, size_t hi,
+			const char *needle, const size_t len);
+const char* search_first_nocase(const char *text, size_t lo, const size_t hi,
+				const char *needle, const size_t len);
+const char* search_last_nocase(const char *text, const size_t lo, size_t hi,
+			       const char *needle, const size_t len);
+
+size_t search_count_newlines(const char *text, const size_t lo, const size_t hi);
+const char* search_newline(const char *text, const size_t lo, const size_t hi,
+			   size_t count);
+const char* search_rnewline(const char *text, const size_t lo, const size_t hi,
+			    size_t count);
+
+#endif /* SEARCH_H */
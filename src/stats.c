@@ -0,0 +1,126 @@
+/*
+ * stats.c - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdatomic.h>
+#include <string.h>
+#include "stats.h"
+#include "eval.h"
+
+/*
+ * Lookups count into a struct telex_stats in their evaluation context, and
+ * add the counts to the totals once, when they are done. Without a struct
+ * telex_stats, and while totals are not collected, nothing is counted.
+ */
+
+static atomic_int collect;
+
+static struct {
+	atomic_size_t lookups;
+	atomic_size_t primaries;
+	atomic_size_t bytes_scanned;
+	atomic_size_t newlines_crossed;
+	atomic_size_t alternatives_tried;
+	atomic_size_t alternatives_failed;
+	atomic_size_t searches[TELEX_SEARCH_MAX];
+} totals;
+
+void telex_stats_collect(const int enable)
+{
+	atomic_store_explicit(&collect, enable, memory_order_relaxed);
+}
+
+void telex_stats_get_totals(struct telex_stats_totals *dst)
+{
+	int i;
+
+	if (!dst) {
+		return;
+	}
+
+	dst->lookups = atomic_load_explicit(&totals.lookups, memory_order_relaxed);
+	dst->primaries = atomic_load_explicit(&totals.primaries, memory_order_relaxed);
+	dst->bytes_scanned = atomic_load_explicit(&totals.bytes_scanned, memory_order_relaxed);
+	dst->newlines_crossed = atomic_load_explicit(&totals.newlines_crossed,
+						     memory_order_relaxed);
+	dst->alternatives_tried = atomic_load_explicit(&totals.alternatives_tried,
+						       memory_order_relaxed);
+	dst->alternatives_failed = atomic_load_explicit(&totals.alternatives_failed,
+							memory_order_relaxed);
+
+	for (i = 0; i < TELEX_SEARCH_MAX; i++) {
+		dst->searches[i] = atomic_load_explicit(&totals.searches[i], memory_order_relaxed);
+	}
+}
+
+void telex_stats_reset_totals(void)
+{
+	int i;
+
+	atomic_store_explicit(&totals.lookups, 0, memory_order_relaxed);
+	atomic_store_explicit(&totals.primaries, 0, memory_order_relaxed);
+	atomic_store_explicit(&totals.bytes_scanned, 0, memory_order_relaxed);
+	atomic_store_explicit(&totals.newlines_crossed, 0, memory_order_relaxed);
+	atomic_store_explicit(&totals.alternatives_tried, 0, memory_order_relaxed);
+	atomic_store_explicit(&totals.alternatives_failed, 0, memory_order_relaxed);
+
+	for (i = 0; i < TELEX_SEARCH_MAX; i++) {
+		atomic_store_explicit(&totals.searches[i], 0, memory_order_relaxed);
+	}
+}
+
+/* stats may be NULL; scratch is used if only the totals are collected */
+void stats_start(struct eval_context *ctx, struct telex_stats *stats,
+		 struct telex_stats *scratch)
+{
+	if (!stats && !atomic_load_explicit(&collect, memory_order_relaxed)) {
+		return;
+	}
+
+	ctx->stats = stats ? stats : scratch;
+	memset(ctx->stats, 0, sizeof(*ctx->stats));
+}
+
+void stats_finish(struct eval_context *ctx)
+{
+	struct telex_stats *stats;
+	int i;
+
+	if (!(stats = ctx->stats) || !atomic_load_explicit(&collect, memory_order_relaxed)) {
+		return;
+	}
+
+	atomic_fetch_add_explicit(&totals.lookups, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&totals.primaries, stats->num_primaries, memory_order_relaxed);
+	atomic_fetch_add_explicit(&totals.bytes_scanned, stats->bytes_scanned,
+				  memory_order_relaxed);
+	atomic_fetch_add_explicit(&totals.newlines_crossed, stats->newlines_crossed,
+				  memory_order_relaxed);
+	atomic_fetch_add_explicit(&totals.alternatives_tried, stats->alternatives_tried,
+				  memory_order_relaxed);
+	atomic_fetch_add_explicit(&totals.alternatives_failed, stats->alternatives_failed,
+				  memory_order_relaxed);
+
+	for (i = 0; i < TELEX_SEARCH_MAX; i++) {
+		if (stats->searches[i]) {
+			atomic_fetch_add_explicit(&totals.searches[i], stats->searches[i],
+						  memory_order_relaxed);
+		}
+	}
+}
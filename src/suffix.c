@@ -0,0 +1,742 @@
+/*
+ * suffix.c - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "suffix.h"
+
+#define SUFFIX_INDEX_MAGIC "TLXSUFX2"
+
+/*
+ * The suffix array tells us where the occurrences of a needle are (one
+ * contiguous range of the array), but not which of them is closest to
+ * a given position. To answer that in logarithmic time, the suffix array
+ * is additionally stored in a wavelet matrix, which can find the smallest
+ * (or largest) value in a range of the array that is not below (or above)
+ * a given bound.
+ */
+
+struct wavelet_level {
+	uint64_t *bits;
+	uint32_t *ranks;
+	uint32_t zeros;
+};
+
+struct suffix_index {
+	const unsigned char *text;
+	uint32_t size;
+	uint32_t *array;
+
+	int num_levels;
+	struct wavelet_level *levels;
+};
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME  0x100000001b3ULL
+
+/* FNV-1a, continuing from hash */
+static uint64_t fnv_hash(uint64_t hash, const void *data, const size_t size)
+{
+	const unsigned char *bytes;
+	size_t i;
+
+	bytes = (const unsigned char*)data;
+
+	for (i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+static int suffix_sort(const unsigned char *text, const uint32_t size, uint32_t *array)
+{
+	uint32_t *rank;
+	uint32_t *tmp;
+	uint32_t *second;
+	uint32_t *count;
+	uint32_t classes;
+	uint32_t k;
+	uint32_t i;
+	int err;
+
+	/*
+	 * Prefix doubling with radix sort: after the round for k, the suffixes
+	 * are sorted by their first 2k characters. Each round is linear, and
+	 * there are at most log2(size) rounds.
+	 */
+
+	rank = malloc(size * sizeof(*rank));
+	tmp = malloc(size * sizeof(*tmp));
+	second = malloc(size * sizeof(*second));
+	count = malloc(((size > 256 ? size : 256) + 1) * sizeof(*count));
+	err = -ENOMEM;
+
+	if (!rank || !tmp || !second || !count) {
+		goto cleanup;
+	}
+
+	memset(count, 0, 257 * sizeof(*count));
+
+	for (i = 0; i < size; i++) {
+		count[text[i] + 1]++;
+	}
+	for (i = 1; i <= 256; i++) {
+		count[i] += count[i - 1];
+	}
+	for (i = 0; i < size; i++) {
+		array[count[text[i]]++] = i;
+	}
+
+	classes = 1;
+	rank[array[0]] = 0;
+
+	for (i = 1; i < size; i++) {
+		if (text[array[i]] != text[array[i - 1]]) {
+			classes++;
+		}
+		rank[array[i]] = classes - 1;
+	}
+
+	for (k = 1; classes < size; k <<= 1) {
+		uint32_t p;
+
+		/* order by the second half first: suffixes without one come first */
+		p = 0;
+		for (i = size - (k < size ? k : size); i < size; i++) {
+			second[p++] = i;
+		}
+		for (i = 0; i < size; i++) {
+			if (array[i] >= k) {
+				second[p++] = array[i] - k;
+			}
+		}
+
+		/* then do a stable sort by the first half */
+		memset(count, 0, (classes + 1) * sizeof(*count));
+
+		for (i = 0; i < size; i++) {
+			count[rank[i] + 1]++;
+		}
+		for (i = 1; i <= classes; i++) {
+			count[i] += count[i - 1];
+		}
+		for (i = 0; i < size; i++) {
+			array[count[rank[second[i]]]++] = second[i];
+		}
+
+		classes = 1;
+		tmp[array[0]] = 0;
+
+		for (i = 1; i < size; i++) {
+			uint32_t cur;
+			uint32_t prev;
+			int64_t cur_second;
+			int64_t prev_second;
+
+			cur = array[i];
+			prev = array[i - 1];
+			cur_second = cur + k < size ? rank[cur + k] : -1;
+			prev_second = prev + k < size ? rank[prev + k] : -1;
+
+			if (rank[cur] != rank[prev] || cur_second != prev_second) {
+				classes++;
+			}
+
+			tmp[cur] = classes - 1;
+		}
+
+		memcpy(rank, tmp, size * sizeof(*rank));
+	}
+
+	err = 0;
+
+cleanup:
+	free(rank);
+	free(tmp);
+	free(second);
+	free(count);
+
+	return err;
+}
+
+static uint32_t wavelet_rank1(struct wavelet_level *level, const uint32_t pos)
+{
+	uint64_t mask;
+
+	mask = (1ULL << (pos & 63)) - 1;
+	return level->ranks[pos >> 6] + __builtin_popcountll(level->bits[pos >> 6] & mask);
+}
+
+static uint32_t wavelet_rank0(struct wavelet_level *level, const uint32_t pos)
+{
+	return pos - wavelet_rank1(level, pos);
+}
+
+static void wavelet_level_update_ranks(struct wavelet_level *level, const uint32_t size)
+{
+	uint32_t words;
+	uint32_t i;
+
+	words = size / 64 + 1;
+	level->ranks[0] = 0;
+
+	for (i = 0; i < words; i++) {
+		level->ranks[i + 1] = level->ranks[i] + __builtin_popcountll(level->bits[i]);
+	}
+}
+
+static int wavelet_level_alloc(struct wavelet_level *level, const uint32_t size)
+{
+	uint32_t words;
+
+	words = size / 64 + 1;
+
+	if (!(level->bits = calloc(words, sizeof(*level->bits))) ||
+	    !(level->ranks = calloc(words + 1, sizeof(*level->ranks)))) {
+		free(level->bits);
+		level->bits = NULL;
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static int wavelet_levels_for(const uint32_t size)
+{
+	int levels;
+
+	for (levels = 1; levels < 32 && ((size - 1) >> levels); levels++);
+
+	return levels;
+}
+
+static int wavelet_build(struct suffix_index *index)
+{
+	uint32_t *cur;
+	uint32_t *next;
+	int level;
+	int err;
+
+	index->num_levels = wavelet_levels_for(index->size);
+
+	if (!(index->levels = calloc(index->num_levels, sizeof(*index->levels)))) {
+		return -ENOMEM;
+	}
+
+	cur = malloc(index->size * sizeof(*cur));
+	next = malloc(index->size * sizeof(*next));
+	err = -ENOMEM;
+
+	if (!cur || !next) {
+		goto cleanup;
+	}
+
+	memcpy(cur, index->array, index->size * sizeof(*cur));
+
+	for (level = 0; level < index->num_levels; level++) {
+		struct wavelet_level *wl;
+		uint32_t *swap;
+		uint32_t zeros;
+		uint32_t ones;
+		uint32_t i;
+		int bit;
+
+		wl = &index->levels[level];
+		bit = index->num_levels - level - 1;
+
+		if ((err = wavelet_level_alloc(wl, index->size)) < 0) {
+			goto cleanup;
+		}
+
+		for (i = 0, zeros = 0; i < index->size; i++) {
+			if ((cur[i] >> bit) & 1) {
+				wl->bits[i >> 6] |= 1ULL << (i & 63);
+			} else {
+				zeros++;
+			}
+		}
+
+		wl->zeros = zeros;
+		wavelet_level_update_ranks(wl, index->size);
+
+		/* stable partition: values with a zero bit move to the front */
+		for (i = 0, ones = zeros, zeros = 0; i < index->size; i++) {
+			if ((cur[i] >> bit) & 1) {
+				next[ones++] = cur[i];
+			} else {
+				next[zeros++] = cur[i];
+			}
+		}
+
+		swap = cur;
+		cur = next;
+		next = swap;
+	}
+
+	err = 0;
+
+cleanup:
+	free(cur);
+	free(next);
+
+	return err;
+}
+
+/* number of values below `bound' in array[left, right) */
+static uint32_t wavelet_count_less(struct suffix_index *index, uint32_t left, uint32_t right,
+				   const uint64_t bound)
+{
+	uint32_t result;
+	int level;
+
+	if (bound >> index->num_levels) {
+		return right - left;
+	}
+
+	result = 0;
+
+	for (level = 0; level < index->num_levels; level++) {
+		struct wavelet_level *wl;
+		uint32_t left0;
+		uint32_t right0;
+
+		wl = &index->levels[level];
+		left0 = wavelet_rank0(wl, left);
+		right0 = wavelet_rank0(wl, right);
+
+		if ((bound >> (index->num_levels - level - 1)) & 1) {
+			result += right0 - left0;
+			left = wl->zeros + (left - left0);
+			right = wl->zeros + (right - right0);
+		} else {
+			left = left0;
+			right = right0;
+		}
+	}
+
+	return result;
+}
+
+/* k-th smallest value (counting from 0) in array[left, right) */
+static uint32_t wavelet_kth_smallest(struct suffix_index *index, uint32_t left, uint32_t right,
+				     uint32_t k)
+{
+	uint32_t value;
+	int level;
+
+	value = 0;
+
+	for (level = 0; level < index->num_levels; level++) {
+		struct wavelet_level *wl;
+		uint32_t left0;
+		uint32_t right0;
+
+		wl = &index->levels[level];
+		left0 = wavelet_rank0(wl, left);
+		right0 = wavelet_rank0(wl, right);
+
+		if (k < right0 - left0) {
+			left = left0;
+			right = right0;
+		} else {
+			k -= right0 - left0;
+			value |= 1U << (index->num_levels - level - 1);
+			left = wl->zeros + (left - left0);
+			right = wl->zeros + (right - right0);
+		}
+	}
+
+	return value;
+}
+
+static int suffix_compare(struct suffix_index *index, const uint32_t suffix,
+			  const char *needle, const size_t len)
+{
+	size_t avail;
+	int cmp;
+
+	avail = index->size - suffix;
+
+	if ((cmp = memcmp(index->text + suffix, needle, avail < len ? avail : len)) != 0) {
+		return cmp;
+	}
+
+	/* a suffix that is a proper prefix of the needle sorts before it */
+	return avail < len ? -1 : 0;
+}
+
+static void suffix_range(struct suffix_index *index, const char *needle, const size_t len,
+			 uint32_t *left, uint32_t *right)
+{
+	uint32_t low;
+	uint32_t high;
+
+	low = 0;
+	high = index->size;
+
+	while (low < high) {
+		uint32_t mid;
+
+		mid = low + (high - low) / 2;
+
+		if (suffix_compare(index, index->array[mid], needle, len) < 0) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	*left = low;
+	high = index->size;
+
+	while (low < high) {
+		uint32_t mid;
+
+		mid = low + (high - low) / 2;
+
+		if (suffix_compare(index, index->array[mid], needle, len) <= 0) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	*right = low;
+}
+
+int suffix_index_next(struct suffix_index *index, const char *needle, const size_t len,
+		      const size_t pos, size_t *result)
+{
+	uint32_t left;
+	uint32_t right;
+	uint32_t below;
+
+	if (!index || !needle || !result) {
+		return -EINVAL;
+	}
+
+	suffix_range(index, needle, len, &left, &right);
+	below = wavelet_count_less(index, left, right, pos);
+
+	if (below >= right - left) {
+		return -ENOENT;
+	}
+
+	/* the levels are only checked for consistency when they are loaded */
+	if ((*result = wavelet_kth_smallest(index, left, right, below)) >= index->size) {
+		return -EBADMSG;
+	}
+
+	return 0;
+}
+
+int suffix_index_prev(struct suffix_index *index, const char *needle, const size_t len,
+		      const size_t pos, size_t *result)
+{
+	uint32_t left;
+	uint32_t right;
+	uint32_t not_above;
+
+	if (!index || !needle || !result) {
+		return -EINVAL;
+	}
+
+	suffix_range(index, needle, len, &left, &right);
+	not_above = wavelet_count_less(index, left, right, (uint64_t)pos + 1);
+
+	if (!not_above) {
+		return -ENOENT;
+	}
+
+	/* the levels are only checked for consistency when they are loaded */
+	if ((*result = wavelet_kth_smallest(index, left, right, not_above - 1)) >= index->size) {
+		return -EBADMSG;
+	}
+
+	return 0;
+}
+
+int suffix_index_build(struct suffix_index **index, const char *text, const size_t size)
+{
+	struct suffix_index *new;
+	int err;
+
+	if (!index || !text || !size) {
+		return -EINVAL;
+	}
+
+	if (size > UINT32_MAX) {
+		return -EFBIG;
+	}
+
+	if (!(new = calloc(1, sizeof(*new)))) {
+		return -ENOMEM;
+	}
+
+	new->text = (const unsigned char*)text;
+	new->size = (uint32_t)size;
+
+	if (!(new->array = malloc(size * sizeof(*new->array)))) {
+		err = -ENOMEM;
+	} else if (!(err = suffix_sort(new->text, new->size, new->array))) {
+		err = wavelet_build(new);
+	}
+
+	if (err < 0) {
+		suffix_index_free(&new);
+		return err;
+	}
+
+	*index = new;
+	return 0;
+}
+
+void suffix_index_free(struct suffix_index **index)
+{
+	if (index && *index) {
+		if ((*index)->levels) {
+			int i;
+
+			for (i = 0; i < (*index)->num_levels; i++) {
+				free((*index)->levels[i].bits);
+				free((*index)->levels[i].ranks);
+			}
+
+			free((*index)->levels);
+		}
+
+		free((*index)->array);
+		free(*index);
+		*index = NULL;
+	}
+}
+
+/*
+ * The serialized index is stored in host byte order. Its header contains the
+ * size and a hash of the text it was built for, so that an index can't be
+ * loaded for a document that has changed since, and a hash of everything
+ * after the header, so that a damaged index isn't loaded either.
+ */
+struct suffix_index_header {
+	char magic[8];
+	uint64_t size;
+	uint64_t hash;
+	uint32_t num_levels;
+	uint32_t reserved;
+	uint64_t payload_hash;
+};
+
+static uint64_t payload_hash(struct suffix_index *index)
+{
+	uint64_t hash;
+	int i;
+
+	hash = fnv_hash(FNV_OFFSET, index->array, index->size * sizeof(*index->array));
+
+	for (i = 0; i < index->num_levels; i++) {
+		struct wavelet_level *wl;
+
+		wl = &index->levels[i];
+		hash = fnv_hash(hash, &wl->zeros, sizeof(wl->zeros));
+		hash = fnv_hash(hash, wl->bits, (index->size / 64 + 1) * sizeof(*wl->bits));
+	}
+
+	return hash;
+}
+
+/* the array has to contain every offset exactly once */
+static int array_is_permutation(const uint32_t *array, const uint32_t size)
+{
+	uint64_t *seen;
+	uint32_t i;
+	int err;
+
+	if (!(seen = calloc(size / 64 + 1, sizeof(*seen)))) {
+		return -ENOMEM;
+	}
+
+	err = 0;
+
+	for (i = 0; i < size; i++) {
+		uint32_t entry;
+
+		entry = array[i];
+
+		if (entry >= size || (seen[entry >> 6] & (1ULL << (entry & 63)))) {
+			err = -EBADMSG;
+			break;
+		}
+
+		seen[entry >> 6] |= 1ULL << (entry & 63);
+	}
+
+	free(seen);
+	return err;
+}
+
+/* ranks and select positions stay inside the array only if zeros matches the bits */
+static int wavelet_level_is_valid(struct wavelet_level *level, const uint32_t size)
+{
+	uint32_t words;
+
+	words = size / 64 + 1;
+
+	/* the bits after the last value have to be clear */
+	if (level->bits[words - 1] & ~((1ULL << (size & 63)) - 1)) {
+		return 0;
+	}
+
+	return level->zeros == size - level->ranks[words];
+}
+
+int suffix_index_save(struct suffix_index *index, FILE *file)
+{
+	struct suffix_index_header header;
+	int i;
+
+	if (!index || !file) {
+		return -EINVAL;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SUFFIX_INDEX_MAGIC, sizeof(header.magic));
+	header.size = index->size;
+	header.hash = fnv_hash(FNV_OFFSET, index->text, index->size);
+	header.num_levels = index->num_levels;
+	header.payload_hash = payload_hash(index);
+
+	if (fwrite(&header, sizeof(header), 1, file) != 1 ||
+	    fwrite(index->array, sizeof(*index->array), index->size, file) != index->size) {
+		return -EIO;
+	}
+
+	for (i = 0; i < index->num_levels; i++) {
+		struct wavelet_level *wl;
+		size_t words;
+
+		wl = &index->levels[i];
+		words = index->size / 64 + 1;
+
+		if (fwrite(&wl->zeros, sizeof(wl->zeros), 1, file) != 1 ||
+		    fwrite(wl->bits, sizeof(*wl->bits), words, file) != words) {
+			return -EIO;
+		}
+	}
+
+	return 0;
+}
+
+int suffix_index_load(struct suffix_index **index, FILE *file,
+		      const char *text, const size_t size)
+{
+	struct suffix_index_header header;
+	struct suffix_index *new;
+	int err;
+	int i;
+
+	if (!index || !file || !text) {
+		return -EINVAL;
+	}
+
+	if (fread(&header, sizeof(header), 1, file) != 1) {
+		return -EIO;
+	}
+
+	if (memcmp(header.magic, SUFFIX_INDEX_MAGIC, sizeof(header.magic)) != 0 ||
+	    header.size != size || size > UINT32_MAX || !size ||
+	    header.num_levels != (uint32_t)wavelet_levels_for(size)) {
+		return -EBADMSG;
+	}
+
+	if (header.hash != fnv_hash(FNV_OFFSET, text, size)) {
+		return -ESTALE;
+	}
+
+	if (!(new = calloc(1, sizeof(*new)))) {
+		return -ENOMEM;
+	}
+
+	new->text = (const unsigned char*)text;
+	new->size = (uint32_t)size;
+	new->num_levels = header.num_levels;
+	err = -ENOMEM;
+
+	if (!(new->array = malloc(size * sizeof(*new->array))) ||
+	    !(new->levels = calloc(new->num_levels, sizeof(*new->levels)))) {
+		goto fail;
+	}
+
+	err = -EIO;
+
+	if (fread(new->array, sizeof(*new->array), size, file) != size) {
+		goto fail;
+	}
+
+	for (i = 0; i < new->num_levels; i++) {
+		struct wavelet_level *wl;
+		size_t words;
+
+		wl = &new->levels[i];
+		words = size / 64 + 1;
+
+		if ((err = wavelet_level_alloc(wl, new->size)) < 0) {
+			goto fail;
+		}
+
+		err = -EIO;
+
+		if (fread(&wl->zeros, sizeof(wl->zeros), 1, file) != 1 ||
+		    fread(wl->bits, sizeof(*wl->bits), words, file) != words) {
+			goto fail;
+		}
+
+		wavelet_level_update_ranks(wl, new->size);
+
+		if (!wavelet_level_is_valid(wl, new->size)) {
+			err = -EBADMSG;
+			goto fail;
+		}
+	}
+
+	/*
+	 * The payload hash catches damaged files, and the checks above and below
+	 * make sure that not even a crafted one makes lookups leave the text.
+	 */
+	if (payload_hash(new) != header.payload_hash) {
+		err = -EBADMSG;
+		goto fail;
+	}
+
+	if ((err = array_is_permutation(new->array, new->size)) < 0) {
+		goto fail;
+	}
+
+	*index = new;
+	return 0;
+
+fail:
+	suffix_index_free(&new);
+	return err;
+}
@@ -0,0 +1,41 @@
+/*
+ * suffix.h - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef SUFFIX_H
+#define SUFFIX_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+struct suffix_index;
+
+int suffix_index_build(struct suffix_index **index, const char *text, const size_t size);
+void suffix_index_free(struct suffix_index **index);
+
+int suffix_index_next(struct suffix_index *index, const char *needle, const size_t len,
+		      const size_t pos, size_t *result);
+int suffix_index_prev(struct suffix_index *index, const char *needle, const size_t len,
+		      const size_t pos, size_t *result);
+
+int suffix_index_save(struct suffix_index *index, FILE *file);
+int suffix_index_load(struct suffix_index **index, FILE *file,
+		      const char *text, const size_t size);
+
+#endif /* SUFFIX_H */
@@ -18,14 +18,22 @@
  * Boston, MA 02111-1307, USA.
  */
 
+#define _GNU_SOURCE
 #include <telex/error.h>
 #include <telex/telex.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdarg.h>
 #include <errno.h>
 #include <stdio.h>
 #include "telex.h"
 #include "parser.h"
+#include "eval.h"
+#include "stats.h"
+#include "probes.h"
+#include "trace.h"
+#include "search.h"
 
 struct telex* telex_new(struct token *prefix,
 			struct compound_expr *compound_expr)
@@ -40,9 +48,6 @@ struct telex* telex_new(struct token *prefix,
 	return telex;
 }
 
-int eval_telex(struct telex *telex, const char *start, const size_t size,
-               const char *pos, token_type_t prefix, const char **result);
-
 int telex_parse(struct telex **telex,
                 const char *input,
                 struct telex_error **errors)
@@ -50,7 +55,10 @@ int telex_parse(struct telex **telex,
 	struct parser *parser;
 	int have_errors;
 
+	PROBE1(parse__start, input);
+
 	if (!(parser = parser_new())) {
+		PROBE2(parse__done, input, -ENOMEM);
 		return -ENOMEM;
 	}
 
@@ -61,43 +69,234 @@ int telex_parse(struct telex **telex,
 	}
 	*errors = parser_get_errors(parser);
 
+	if (trace_active()) {
+		trace_parse(input, have_errors ? NULL : *telex);
+	}
+
 	parser_free(parser);
+	PROBE2(parse__done, input, have_errors);
+
+	return have_errors;
+}
+
+int telex_range_parse(struct telex_range **range,
+		      const char *input,
+		      struct telex_error **errors)
+{
+	struct parser *parser;
+	int have_errors;
+
+	if (!range || !input || !errors) {
+		return -EINVAL;
+	}
+
+	if (!(parser = parser_new())) {
+		return -ENOMEM;
+	}
 
+	if (!(have_errors = parser_parse_range(parser, input))) {
+		*range = parser_get_range(parser);
+	}
+	*errors = parser_get_errors(parser);
+
+	parser_free(parser);
 	return have_errors;
 }
 
+static struct token* integer_token(const long value)
+{
+	char lexeme[32];
+	int len;
+
+	len = snprintf(lexeme, sizeof(lexeme), "%ld", value);
+	return token_new(TOKEN_INTEGER, lexeme, len, -1, -1);
+}
+
+/* the alternative ":value" if type is TOKEN_COLON, otherwise "#value" */
+struct or_expr* position_or_expr(const token_type_t type, const long value)
+{
+	struct primary_expr *primary;
+	struct token *integer;
+	struct or_expr *expr;
+	struct token *op;
+
+	op = token_new(type, type == TOKEN_COLON ? ":" : "#", 1, -1, -1);
+	integer = integer_token(value);
+
+	if (!op || !integer || !(primary = calloc(1, sizeof(*primary)))) {
+		goto cleanup;
+	}
+
+	if (type == TOKEN_COLON) {
+		if (!(primary->line_expr = calloc(1, sizeof(*primary->line_expr)))) {
+			free(primary);
+			goto cleanup;
+		}
+
+		primary->line_expr->colon = op;
+		primary->line_expr->integer = integer;
+	} else {
+		if (!(primary->col_expr = calloc(1, sizeof(*primary->col_expr)))) {
+			free(primary);
+			goto cleanup;
+		}
+
+		primary->col_expr->pound = op;
+		primary->col_expr->integer = integer;
+	}
+
+	if (!(expr = or_expr_new(NULL, NULL, primary))) {
+		primary_expr_free(&primary);
+	}
+
+	return expr;
+
+cleanup:
+	token_free(&op);
+	token_free(&integer);
+	return NULL;
+}
+
+/* the alternative "\"str\"", where str must not need to be escaped */
+struct or_expr* string_or_expr(const char *str, const size_t len)
+{
+	struct primary_expr *primary;
+	struct token *string;
+	struct or_expr *expr;
+	char *quoted;
+
+	if (!(quoted = malloc(len + 2))) {
+		return NULL;
+	}
+
+	quoted[0] = '"';
+	memcpy(quoted + 1, str, len);
+	quoted[len + 1] = '"';
+
+	string = token_new(TOKEN_STRING, quoted, len + 2, -1, -1);
+	free(quoted);
+
+	if (!string || !(primary = calloc(1, sizeof(*primary)))) {
+		token_free(&string);
+		return NULL;
+	}
+
+	if (!(primary->stringy = calloc(1, sizeof(*primary->stringy)))) {
+		free(primary);
+		token_free(&string);
+		return NULL;
+	}
+
+	primary->stringy->token = string;
+
+	if (!(expr = or_expr_new(NULL, NULL, primary))) {
+		primary_expr_free(&primary);
+	}
+
+	return expr;
+}
+
+/* the same telex that parsing ":line>#col" results in */
+int position_telex(struct telex **telex, const long line, const long col)
+{
+	struct compound_expr *line_step;
+	struct compound_expr *col_step;
+	struct or_expr *line_expr;
+	struct or_expr *col_expr;
+	struct token *greater;
+
+	line_step = NULL;
+	col_step = NULL;
+	line_expr = position_or_expr(TOKEN_COLON, line);
+	col_expr = position_or_expr(TOKEN_POUND, col);
+	greater = token_new(TOKEN_GREATER, ">", 1, -1, -1);
+
+	if (line_expr && col_expr && greater &&
+	    (line_step = compound_expr_new(NULL, NULL, line_expr))) {
+		line_expr = NULL;
+
+		if ((col_step = compound_expr_new(line_step, greater, col_expr))) {
+			line_step = NULL;
+			col_expr = NULL;
+			greater = NULL;
+
+			if ((*telex = telex_new(NULL, col_step))) {
+				return 0;
+			}
+		}
+	}
+
+	or_expr_free(&line_expr);
+	or_expr_free(&col_expr);
+	token_free(&greater);
+	compound_expr_free(&line_step);
+	compound_expr_free(&col_step);
+
+	return -ENOMEM;
+}
+
 int telex_rlookup(struct telex **telex, const char *start, const char *pos)
 {
-	struct telex_error *errors;
-	char telex_str[64];
-	const char *cur;
-	int line;
-	int col;
+	const char *line_start;
+	long line;
+
+	if (!telex || !start || !pos || pos < start) {
+		return -EINVAL;
+	}
+
+	line = search_count_newlines(start, 0, pos - start) + 1;
+	line_start = memrchr(start, '\n', pos - start);
+	line_start = line_start ? line_start + 1 : start;
+
+	return position_telex(telex, line, pos - line_start);
+}
+
+int telex_rlookup_batch(struct telex **telexes, const char *start,
+			const char **positions, const size_t num_positions)
+{
+	const char *line_start;
+	const char *prev;
+	long line;
+	size_t i;
 	int err;
 
-	if (!telex || !start || !pos) {
+	if (!telexes || !start || (!positions && num_positions)) {
 		return -EINVAL;
 	}
 
 	line = 1;
-	col = 0;
+	line_start = start;
+	prev = start;
 
-	for (cur = start; cur < pos; cur++) {
-		if (*cur == '\n') {
-			line++;
-			col = 0;
-			continue;
+	/* every position continues counting where the previous one stopped */
+	for (i = 0; i < num_positions; i++) {
+		const char *newline;
+
+		if (!positions[i] || positions[i] < prev) {
+			err = -EINVAL;
+			goto cleanup;
 		}
 
-		col++;
-	}
+		if (positions[i] > prev) {
+			line += search_count_newlines(start, prev - start, positions[i] - start);
+
+			if ((newline = memrchr(prev, '\n', positions[i] - prev))) {
+				line_start = newline + 1;
+			}
+
+			prev = positions[i];
+		}
 
-	snprintf(telex_str, sizeof(telex_str), ":%d>#%d", line, col);
+		if ((err = position_telex(&telexes[i], line, positions[i] - line_start)) < 0) {
+			goto cleanup;
+		}
+	}
 
-	err = telex_parse(telex, telex_str, &errors);
+	return 0;
 
-	if (err < 0 && errors) {
-		telex_error_free_all(&errors);
+cleanup:
+	while (i > 0) {
+		telex_free(&telexes[--i]);
 	}
 
 	return err;
@@ -108,6 +307,20 @@ void telex_debug(struct telex *telex)
         parser_debug_telex(telex);
 }
 
+/*
+ * Like snprintf(), the to_string functions return the length of the whole
+ * string, even if it did not fit, so offsets may be past the end of str.
+ */
+static char* str_at(char *str, const size_t str_size, const int offset)
+{
+	return (size_t)offset < str_size ? str + offset : str + str_size;
+}
+
+static size_t str_left(const size_t str_size, const int offset)
+{
+	return (size_t)offset < str_size ? str_size - offset : 0;
+}
+
 int line_expr_to_string(struct line_expr *expr, char *str, const size_t str_size)
 {
 	int total;
@@ -117,7 +330,8 @@ int line_expr_to_string(struct line_expr *expr, char *str, const size_t str_size
 		return total;
 	}
 
-	if ((written = token_to_string(expr->integer, str + total, str_size - total)) < 0) {
+	if ((written = token_to_string(expr->integer, str_at(str, str_size, total),
+				       str_left(str_size, total))) < 0) {
 		return total;
 	}
 
@@ -137,7 +351,8 @@ int col_expr_to_string(struct col_expr *expr, char *str, const size_t str_size)
 		}
 	}
 
-	if ((written = token_to_string(expr->integer, str + total, str_size - total)) < 0) {
+	if ((written = token_to_string(expr->integer, str_at(str, str_size, total),
+				       str_left(str_size, total))) < 0) {
 		return total;
 	}
 
@@ -146,7 +361,57 @@ int col_expr_to_string(struct col_expr *expr, char *str, const size_t str_size)
 
 int stringy_to_string(struct stringy *stringy, char *str, const size_t str_size)
 {
-	return token_to_string(stringy->token, str, str_size);
+	int total;
+	int written;
+
+	total = 0;
+
+	if (stringy->count) {
+		if ((total = token_to_string(stringy->count, str, str_size)) < 0) {
+			return total;
+		}
+
+		if ((written = token_to_string(stringy->star, str_at(str, str_size, total),
+					       str_left(str_size, total))) < 0) {
+			return total;
+		}
+
+		total += written;
+	}
+
+	if ((written = token_to_string(stringy->token, str_at(str, str_size, total),
+				       str_left(str_size, total))) < 0) {
+		return total;
+	}
+
+	total += written;
+
+	if (stringy->nocase) {
+		if ((written = token_to_string(stringy->nocase, str_at(str, str_size, total),
+					       str_left(str_size, total))) < 0) {
+			return total;
+		}
+
+		total += written;
+	}
+
+	if (stringy->scope) {
+		if ((written = token_to_string(stringy->at, str_at(str, str_size, total),
+					       str_left(str_size, total))) < 0) {
+			return total;
+		}
+
+		total += written;
+
+		if ((written = token_to_string(stringy->scope, str_at(str, str_size, total),
+					       str_left(str_size, total))) < 0) {
+			return total;
+		}
+
+		total += written;
+	}
+
+	return total;
 }
 
 int primary_expr_to_string(struct primary_expr *expr, char *str, const size_t str_size)
@@ -170,13 +435,15 @@ int primary_expr_to_string(struct primary_expr *expr, char *str, const size_t st
 		goto done;
 	}
 
-	if ((written = telex_to_string(expr->telex, str + total, str_size - total)) < 0) {
+	if ((written = telex_to_string(expr->telex, str_at(str, str_size, total),
+				       str_left(str_size, total))) < 0) {
 		goto done;
 	}
 
 	total += written;
 
-	if ((written = token_to_string(expr->rparen, str + total, str_size - total)) < 0) {
+	if ((written = token_to_string(expr->rparen, str_at(str, str_size, total),
+				       str_left(str_size, total))) < 0) {
 		goto done;
 	}
 
@@ -203,8 +470,8 @@ int or_expr_to_string(struct or_expr *expr, char *str, const size_t str_size)
 	}
 
 	if (expr->or) {
-		if ((written = token_to_string(expr->or, str + total,
-					       str_size - total)) < 0) {
+		if ((written = token_to_string(expr->or, str_at(str, str_size, total),
+					       str_left(str_size, total))) < 0) {
 			goto done;
 		}
 
@@ -212,8 +479,9 @@ int or_expr_to_string(struct or_expr *expr, char *str, const size_t str_size)
 	}
 
 	if (expr->primary_expr) {
-		if ((written = primary_expr_to_string(expr->primary_expr, str + total,
-						      str_size - total)) < 0) {
+		if ((written = primary_expr_to_string(expr->primary_expr,
+						      str_at(str, str_size, total),
+						      str_left(str_size, total))) < 0) {
 			goto done;
 		}
 
@@ -240,7 +508,8 @@ int compound_expr_to_string(struct compound_expr *expr, char *str, const size_t
 	}
 
 	if (expr->prefix) {
-		if ((written = token_to_string(expr->prefix, str + total, str_size - total)) < 0) {
+		if ((written = token_to_string(expr->prefix, str_at(str, str_size, total),
+					       str_left(str_size, total))) < 0) {
 			goto done;
 		}
 
@@ -248,7 +517,8 @@ int compound_expr_to_string(struct compound_expr *expr, char *str, const size_t
 	}
 
 	if (expr->or_expr) {
-		if ((written = or_expr_to_string(expr->or_expr, str + total, str_size - total)) < 0) {
+		if ((written = or_expr_to_string(expr->or_expr, str_at(str, str_size, total),
+						 str_left(str_size, total))) < 0) {
 			goto done;
 		}
 
@@ -261,11 +531,47 @@ done:
 
 int telex_to_string(struct telex *telex, char *str, const size_t str_size)
 {
+	int total;
+	int written;
+
+	if ((total = telex->prefix ? token_to_string(telex->prefix, str, str_size) : 0) < 0) {
+		return total;
+	}
+
+	if ((written = compound_expr_to_string(telex->compound_expr, str_at(str, str_size, total),
+					       str_left(str_size, total))) < 0) {
+		return total;
+	}
+
+	return total + written;
+}
+
+int telex_range_to_string(struct telex_range *range, char *str, const size_t str_size)
+{
+	int total;
 	int written;
 
-	written = telex->prefix ? token_to_string(telex->prefix, str, str_size) : 0;
+	if (!range) {
+		return -EINVAL;
+	}
+
+	if ((total = telex_to_string(range->start, str, str_size)) < 0) {
+		return total;
+	}
+
+	if ((written = token_to_string(range->comma, str_at(str, str_size, total),
+				       str_left(str_size, total))) < 0) {
+		return total;
+	}
+
+	total += written;
+
+	if ((written = telex_to_string(range->end, str_at(str, str_size, total),
+				       str_left(str_size, total))) < 0) {
+		return total;
+	}
 
-	return compound_expr_to_string(telex->compound_expr, str + written, str_size - written);
+	return total + written;
 }
 
 static struct primary_expr* primary_expr_from_telex(struct telex *telex)
@@ -389,28 +695,150 @@ const char* telex_lookup(struct telex *telex,
 			 const size_t size,
 			 const char *pos)
 {
+	return telex_lookup_stats(telex, start, size, pos, NULL);
+}
+
+const char* telex_lookup_stats(struct telex *telex,
+			       const char *start,
+			       const size_t size,
+			       const char *pos,
+			       struct telex_stats *stats)
+{
+	struct telex_stats scratch;
+	struct eval_context ctx;
 	const char *result;
 	token_type_t prefix;
+	int err;
 
+	eval_context_init(&ctx, start, size, NULL);
+	stats_start(&ctx, stats, &scratch);
 	result = NULL;
 	prefix = telex->prefix ? telex->prefix->type : TOKEN_INVALID;
 
-	if (eval_telex(telex, start, size, pos, prefix, &result) < 0) {
+	err = eval_telex(telex, &ctx, pos, prefix, &result);
+	stats_finish(&ctx);
+
+	if (err < 0) {
+		result = NULL;
+	}
+
+	if (trace_active()) {
+		trace_lookup(telex, start, size, pos, result);
+	}
+
+	return result;
+}
+
+const char* telex_lookup_span(struct telex *telex, const char *start, const size_t size,
+			      const char *pos, struct telex_span *span)
+{
+	struct telex_stats scratch;
+	struct eval_context ctx;
+	const char *result;
+	token_type_t prefix;
+	int err;
+
+	if (!telex || !span) {
 		return NULL;
 	}
 
+	eval_context_init(&ctx, start, size, NULL);
+	stats_start(&ctx, NULL, &scratch);
+	ctx.span = span;
+	result = NULL;
+	prefix = telex->prefix ? telex->prefix->type : TOKEN_INVALID;
+
+	err = eval_telex(telex, &ctx, pos, prefix, &result);
+	stats_finish(&ctx);
+
+	if (err < 0) {
+		span->begin = NULL;
+		span->end = NULL;
+		result = NULL;
+	}
+
+	if (trace_active()) {
+		trace_lookup(telex, start, size, pos, result);
+	}
+
 	return result;
 }
 
+int telex_range_lookup(struct telex_range *range, const char *start, const size_t size,
+		       const char *pos, struct telex_span *span)
+{
+	struct telex_stats scratch;
+	struct eval_context ctx;
+	int err;
+
+	if (!range || !start || !span) {
+		return -EINVAL;
+	}
+
+	eval_context_init(&ctx, start, size, NULL);
+	stats_start(&ctx, NULL, &scratch);
+
+	if ((err = eval_range(range, &ctx, pos, span)) < 0) {
+		span->begin = NULL;
+		span->end = NULL;
+	}
+
+	stats_finish(&ctx);
+
+	if (trace_active()) {
+		trace_lookup_range(range, start, size, pos, err, span);
+	}
+
+	return err;
+}
+
+int telex_lookup_limited(struct telex *telex,
+			 const char *start,
+			 const size_t size,
+			 const char *pos,
+			 const struct telex_limits *limits,
+			 const char **result)
+{
+	struct telex_stats scratch;
+	struct eval_context ctx;
+	const char *found;
+	token_type_t prefix;
+	int err;
+
+	if (!telex || !start || !result) {
+		return -EINVAL;
+	}
+
+	eval_context_init(&ctx, start, size, NULL);
+	stats_start(&ctx, NULL, &scratch);
+	ctx.limits = limits;
+	prefix = telex->prefix ? telex->prefix->type : TOKEN_INVALID;
+	found = NULL;
+
+	err = eval_telex(telex, &ctx, pos, prefix, &found);
+	stats_finish(&ctx);
+	*result = err < 0 ? NULL : found;
+
+	if (trace_active()) {
+		trace_lookup_limited(telex, start, size, pos, limits, err, *result);
+	}
+
+	return err;
+}
+
 const char* telex_lookup_multi(const char *start,
 			       const size_t size,
 			       const char *pos,
 			       const int n, ...)
 {
+	struct telex_stats scratch;
+	struct eval_context ctx;
 	token_type_t prefix;
 	va_list args;
 	int i;
 
+	eval_context_init(&ctx, start, size, NULL);
+	stats_start(&ctx, NULL, &scratch);
 	prefix = TOKEN_INVALID;
 	va_start(args, n);
 
@@ -424,7 +852,7 @@ const char* telex_lookup_multi(const char *start,
 			prefix = telex->prefix->type;
 		}
 
-		err = eval_telex(telex, start, size, pos, prefix, &pos);
+		err = eval_telex(telex, &ctx, pos, prefix, &pos);
 
 		if (err < 0) {
 			pos = NULL;
@@ -433,6 +861,66 @@ const char* telex_lookup_multi(const char *start,
 	}
 
 	va_end(args);
+	stats_finish(&ctx);
+
+	return pos;
+}
+
+const char* telex_lookup_array(struct telex **telexes, const size_t n, const char *start,
+			       const size_t size, const char *pos, const char **positions)
+{
+	struct telex_stats scratch;
+	struct eval_context ctx;
+	token_type_t prefix;
+	const char *origin;
+	size_t num_positions;
+	size_t i;
+
+	if (!telexes || !start) {
+		return NULL;
+	}
+
+	for (num_positions = 0, i = 0; i < n; i++) {
+		if (!telexes[i]) {
+			return NULL;
+		}
+
+		num_positions += telex_num_steps(telexes[i]);
+	}
+
+	/* steps that are not reached have no position */
+	if (positions) {
+		for (i = 0; i < num_positions; i++) {
+			positions[i] = NULL;
+		}
+	}
+
+	eval_context_init(&ctx, start, size, NULL);
+	stats_start(&ctx, NULL, &scratch);
+	prefix = TOKEN_INVALID;
+	origin = pos;
+
+	for (i = 0; i < n; i++) {
+		int err;
+
+		if (telexes[i]->prefix) {
+			prefix = telexes[i]->prefix->type;
+		}
+
+		err = eval_telex_steps(telexes[i], &ctx, pos, prefix, &pos,
+				       positions ? &positions : NULL);
+
+		if (err < 0) {
+			pos = NULL;
+			break;
+		}
+	}
+
+	stats_finish(&ctx);
+
+	if (trace_active()) {
+		trace_lookup_array(telexes, n, start, size, origin, pos);
+	}
 
 	return pos;
 }
@@ -501,8 +989,12 @@ struct stringy* stringy_clone(struct stringy *stringy)
 	struct stringy *clone;
 
 	if ((clone = calloc(1, sizeof(*clone)))) {
-		if (stringy->token &&
-		    !(clone->token = token_clone(stringy->token))) {
+		if ((stringy->token && !(clone->token = token_clone(stringy->token))) ||
+		    (stringy->count && !(clone->count = token_clone(stringy->count))) ||
+		    (stringy->star && !(clone->star = token_clone(stringy->star))) ||
+		    (stringy->nocase && !(clone->nocase = token_clone(stringy->nocase))) ||
+		    (stringy->at && !(clone->at = token_clone(stringy->at))) ||
+		    (stringy->scope && !(clone->scope = token_clone(stringy->scope)))) {
 			stringy_free(&clone);
 		}
 	}
@@ -516,6 +1008,21 @@ void stringy_free(struct stringy **stringy)
 		if ((*stringy)->token) {
 			token_free(&(*stringy)->token);
 		}
+		if ((*stringy)->count) {
+			token_free(&(*stringy)->count);
+		}
+		if ((*stringy)->star) {
+			token_free(&(*stringy)->star);
+		}
+		if ((*stringy)->nocase) {
+			token_free(&(*stringy)->nocase);
+		}
+		if ((*stringy)->at) {
+			token_free(&(*stringy)->at);
+		}
+		if ((*stringy)->scope) {
+			token_free(&(*stringy)->scope);
+		}
 
 		free(*stringy);
 		*stringy = NULL;
@@ -784,6 +1291,21 @@ void telex_free(struct telex **telex)
 	}
 }
 
+void telex_range_free(struct telex_range **range)
+{
+	if (range && *range) {
+		telex_free(&(*range)->start);
+		telex_free(&(*range)->end);
+
+		if ((*range)->comma) {
+			token_free(&(*range)->comma);
+		}
+
+		free(*range);
+		*range = NULL;
+	}
+}
+
 int telex_is_relative(const struct telex *telex)
 {
 	if (!telex) {
@@ -792,3 +1314,227 @@ int telex_is_relative(const struct telex *telex)
 
 	return telex->prefix != NULL;
 }
+
+int telex_num_steps(const struct telex *telex)
+{
+	struct compound_expr *step;
+	int num_steps;
+
+	if (!telex) {
+		return -EINVAL;
+	}
+
+	for (num_steps = 0, step = telex->compound_expr; step; step = step->compound_expr) {
+		num_steps++;
+	}
+
+	return num_steps;
+}
+
+static int token_equal(const struct token *a, const struct token *b)
+{
+	if (!a || !b) {
+		return a == b;
+	}
+
+	return a->type == b->type &&
+		a->lexeme_len == b->lexeme_len &&
+		memcmp(a->lexeme, b->lexeme, a->lexeme_len) == 0;
+}
+
+static int primary_expr_equal(const struct primary_expr *a, const struct primary_expr *b);
+
+int or_expr_equal(const struct or_expr *a, const struct or_expr *b)
+{
+	if (!a || !b) {
+		return a == b;
+	}
+
+	return token_equal(a->or, b->or) &&
+		primary_expr_equal(a->primary_expr, b->primary_expr) &&
+		or_expr_equal(a->or_expr, b->or_expr);
+}
+
+static int compound_expr_equal(const struct compound_expr *a, const struct compound_expr *b)
+{
+	if (!a || !b) {
+		return a == b;
+	}
+
+	return token_equal(a->prefix, b->prefix) &&
+		or_expr_equal(a->or_expr, b->or_expr) &&
+		compound_expr_equal(a->compound_expr, b->compound_expr);
+}
+
+static int primary_expr_equal(const struct primary_expr *a, const struct primary_expr *b)
+{
+	if (!a || !b) {
+		return a == b;
+	}
+
+	if (!a->stringy != !b->stringy ||
+	    !a->line_expr != !b->line_expr ||
+	    !a->col_expr != !b->col_expr) {
+		return 0;
+	}
+
+	if (a->stringy) {
+		return token_equal(a->stringy->token, b->stringy->token) &&
+			token_equal(a->stringy->count, b->stringy->count) &&
+			token_equal(a->stringy->nocase, b->stringy->nocase) &&
+			token_equal(a->stringy->scope, b->stringy->scope);
+	}
+
+	if (a->line_expr) {
+		return token_equal(a->line_expr->integer, b->line_expr->integer);
+	}
+
+	if (a->col_expr) {
+		return token_equal(a->col_expr->pound, b->col_expr->pound) &&
+			token_equal(a->col_expr->integer, b->col_expr->integer);
+	}
+
+	return telex_equal(a->telex, b->telex);
+}
+
+int telex_equal(const struct telex *a, const struct telex *b)
+{
+	if (!a || !b) {
+		return a == b;
+	}
+
+	return token_equal(a->prefix, b->prefix) &&
+		compound_expr_equal(a->compound_expr, b->compound_expr);
+}
+
+static uint64_t hash_bytes(uint64_t hash, const void *data, const size_t size)
+{
+	const unsigned char *bytes;
+	size_t i;
+
+	bytes = data;
+
+	/* FNV-1a */
+	for (i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+static uint64_t token_hash(uint64_t hash, const struct token *token)
+{
+	if (!token) {
+		return hash_bytes(hash, "", 1);
+	}
+
+	hash = hash_bytes(hash, &token->type, sizeof(token->type));
+	return hash_bytes(hash, token->lexeme, token->lexeme_len);
+}
+
+static uint64_t primary_expr_hash(uint64_t hash, const struct primary_expr *expr);
+
+uint64_t or_expr_hash(uint64_t hash, const struct or_expr *expr)
+{
+	for (; expr; expr = expr->or_expr) {
+		hash = token_hash(hash, expr->or);
+		hash = primary_expr_hash(hash, expr->primary_expr);
+	}
+
+	return hash;
+}
+
+static uint64_t compound_expr_hash(uint64_t hash, const struct compound_expr *expr)
+{
+	for (; expr; expr = expr->compound_expr) {
+		hash = token_hash(hash, expr->prefix);
+		hash = or_expr_hash(hash, expr->or_expr);
+	}
+
+	return hash;
+}
+
+static uint64_t primary_expr_hash(uint64_t hash, const struct primary_expr *expr)
+{
+	uint64_t nested;
+
+	if (!expr) {
+		return hash;
+	}
+
+	if (expr->stringy) {
+		hash = token_hash(hash, expr->stringy->count);
+		hash = token_hash(hash, expr->stringy->nocase);
+		hash = token_hash(hash, expr->stringy->scope);
+		return token_hash(hash, expr->stringy->token);
+	}
+
+	if (expr->line_expr) {
+		hash = token_hash(hash, expr->line_expr->colon);
+		return token_hash(hash, expr->line_expr->integer);
+	}
+
+	if (expr->col_expr) {
+		hash = token_hash(hash, expr->col_expr->pound);
+		return token_hash(hash, expr->col_expr->integer);
+	}
+
+	nested = telex_hash(expr->telex);
+
+	hash = token_hash(hash, expr->lparen);
+	hash = hash_bytes(hash, &nested, sizeof(nested));
+	return token_hash(hash, expr->rparen);
+}
+
+uint64_t telex_hash(const struct telex *telex)
+{
+	uint64_t hash;
+
+	hash = 0xcbf29ce484222325ULL;
+
+	if (!telex) {
+		return hash;
+	}
+
+	/*
+	 * Telexes don't change after they have been built, so any thread that
+	 * computes the hash computes the same value, and a relaxed store is
+	 * enough to share it with the others.
+	 */
+	if ((hash = atomic_load_explicit(&telex->hash, memory_order_relaxed))) {
+		return hash;
+	}
+
+	hash = token_hash(0xcbf29ce484222325ULL, telex->prefix);
+	hash = compound_expr_hash(hash, telex->compound_expr);
+	atomic_store_explicit(&((struct telex*)telex)->hash, hash, memory_order_relaxed);
+
+	return hash;
+}
+
+int compound_expr_flatten(struct compound_expr *expr, struct compound_expr ***steps)
+{
+	struct compound_expr *cur;
+	int num_steps;
+	int i;
+
+	if (!expr || !steps) {
+		return -EINVAL;
+	}
+
+	for (num_steps = 0, cur = expr; cur; cur = cur->compound_expr) {
+		num_steps++;
+	}
+
+	if (!(*steps = malloc(num_steps * sizeof(**steps)))) {
+		return -ENOMEM;
+	}
+
+	/* the chain is left-recursive, so the first step is at the bottom */
+	for (i = num_steps - 1, cur = expr; cur; cur = cur->compound_expr, i--) {
+		(*steps)[i] = cur;
+	}
+
+	return num_steps;
+}
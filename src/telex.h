@@ -22,6 +22,8 @@
 #define TELEX_H
 
 #include <telex/telex.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include "token.h"
 
 struct telex;
@@ -43,7 +45,18 @@ struct line_expr* line_expr_clone(struct line_expr *expr);
 void line_expr_free(struct line_expr **expr);
 
 struct stringy {
+	/* both NULL unless the string is repeated, as in 3*"needle" */
+	struct token *count;
+	struct token *star;
+
 	struct token *token;
+
+	/* NULL unless letters match either case, as in "needle"i */
+	struct token *nocase;
+
+	/* both NULL unless the search is scoped, as in "needle"@2 */
+	struct token *at;
+	struct token *scope;
 };
 
 struct stringy* stringy_clone(struct stringy *stringy);
@@ -64,6 +77,7 @@ struct primary_expr* primary_expr_nested_new(struct token *lparen,
 					     struct token *rparen);
 struct primary_expr* primary_expr_clone(struct primary_expr *expr);
 void primary_expr_free(struct primary_expr **expr);
+int primary_expr_to_string(struct primary_expr *expr, char *str, const size_t str_size);
 
 struct or_expr {
 	struct or_expr *or_expr;
@@ -76,6 +90,11 @@ struct or_expr* or_expr_new(struct or_expr *or_expr,
 			    struct primary_expr *primary_expr);
 struct or_expr* or_expr_clone(struct or_expr *expr);
 void or_expr_free(struct or_expr **expr);
+int or_expr_equal(const struct or_expr *a, const struct or_expr *b);
+uint64_t or_expr_hash(uint64_t hash, const struct or_expr *expr);
+int or_expr_to_string(struct or_expr *expr, char *str, const size_t str_size);
+struct or_expr* position_or_expr(const token_type_t type, const long value);
+struct or_expr* string_or_expr(const char *str, const size_t len);
 
 struct compound_expr {
 	struct compound_expr *compound_expr;
@@ -88,13 +107,30 @@ struct compound_expr* compound_expr_new(struct compound_expr *compound_expr,
 					struct or_expr *or_expr);
 struct compound_expr* compound_expr_clone(struct compound_expr *expr);
 void compound_expr_free(struct compound_expr **expr);
+int compound_expr_flatten(struct compound_expr *expr, struct compound_expr ***steps);
 
 struct telex {
 	struct token *prefix;
 	struct compound_expr *compound_expr;
+
+	/* computed on first use; zero until then */
+	_Atomic uint64_t hash;
+
+	/* the number of the telex in the trace that is being recorded */
+	_Atomic uint64_t trace_id;
 };
 
 struct telex* telex_new(struct token *prefix,
 			struct compound_expr *compound_expr);
+int telex_equal(const struct telex *a, const struct telex *b);
+uint64_t telex_hash(const struct telex *telex);
+int position_telex(struct telex **telex, const long line, const long col);
+
+/* the end of a range is evaluated from the result of its start */
+struct telex_range {
+	struct telex *start;
+	struct token *comma;
+	struct telex *end;
+};
 
 #endif /* TELEX_H */
@@ -27,6 +27,7 @@
 #include <telex/error.h>
 #include "error.h"
 #include "token.h"
+#include "probes.h"
 
 static const char *_token_names[] = {
 	"TOKEN_INVALID",
@@ -45,6 +46,10 @@ static const char *_token_names[] = {
 	"TOKEN_COLON",
 	"TOKEN_POUND",
 	"TOKEN_OR",
+	"TOKEN_STAR",
+	"TOKEN_AT",
+	"TOKEN_COMMA",
+	"TOKEN_NOCASE",
 	"TOKEN_EOF",
 	"TOKEN_ANY",
 	NULL
@@ -204,7 +209,11 @@ static const token_type_t _direct_map[] = {
 	['#'] = TOKEN_POUND,
 	['('] = TOKEN_LPAREN,
 	[')'] = TOKEN_RPAREN,
-	['|'] = TOKEN_OR
+	['|'] = TOKEN_OR,
+	['*'] = TOKEN_STAR,
+	['@'] = TOKEN_AT,
+	[','] = TOKEN_COMMA,
+	['i'] = TOKEN_NOCASE
 };
 
 static token_type_t _token_identify(const char *start, const char **end)
@@ -227,6 +236,10 @@ static token_type_t _token_identify(const char *start, const char **end)
 	case '(':
 	case ')':
 	case '|':
+	case '*':
+	case '@':
+	case ',':
+	case 'i':
 		*end = tail;
 		/* fall through */
 	case '\0':
@@ -355,12 +368,16 @@ struct token* tokenize(const char *input, struct telex_error **error)
 	struct token *tokens;
 	struct token **last;
 	const char *cur;
+	int num_tokens;
 	int line;
 	int col;
 
+	PROBE1(tokenize__start, input);
+
 	tokens = NULL;
 	last = &tokens;
 	cur = input;
+	num_tokens = 0;
 	line = 1;
 	col = 1;
 
@@ -404,8 +421,12 @@ struct token* tokenize(const char *input, struct telex_error **error)
 		col += len;
 		last = &(*last)->next;
 		cur = next;
+		num_tokens++;
 	}
 
+	/* on errors, the number of tokens is the number that were recognized */
+	PROBE3(tokenize__done, input, num_tokens, tokens ? 0 : -EBADMSG);
+
 	return tokens;
 }
 
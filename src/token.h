@@ -41,6 +41,10 @@ typedef enum {
 	TOKEN_COLON,
 	TOKEN_POUND,
 	TOKEN_OR,
+	TOKEN_STAR,
+	TOKEN_AT,
+	TOKEN_COMMA,
+	TOKEN_NOCASE,
 	TOKEN_EOF,
 	TOKEN_ANY
 } token_type_t;
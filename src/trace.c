@@ -0,0 +1,389 @@
+/*
+ * trace.c - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <telex/telex.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "trace.h"
+#include "telex.h"
+
+/*
+ * A trace is a text file that starts with a "telex-trace <version>" line
+ * and has one record for every call:
+ *
+ *   P <telex> <length>\n<input>\n   a parsed telex, or one seen the first time
+ *   D <doc> <size>                  a document seen the first time
+ *   L <telex> <doc> <pos> <result>  a lookup; offsets are "-" for NULL
+ *   M <telex> <doc> <pos> <max_bytes> <max_lines> <err> <result>
+ *                                   a limited lookup
+ *   A <doc> <pos> <result> <n> <telex>...
+ *                                   a lookup through n telexes in a row
+ *   R <start> <end> <doc> <pos> <err> <begin> <end>
+ *                                   a range lookup, with the telexes of
+ *                                   both ends of the range
+ *
+ * Telexes and documents are numbered from 1 in the order they were first
+ * seen, and telex 0 is an input that could not be parsed. Telexes keep
+ * their number in trace_id, together with the number of the trace, so
+ * that numbers from an earlier trace are not reused.
+ *
+ * Version 1 only had P, D and L records. Version 2 added M, A and R, and
+ * the replay tool reads both.
+ */
+
+#define TRACE_VERSION 2
+
+struct trace_doc {
+	const char *start;
+	size_t size;
+	unsigned long id;
+};
+
+atomic_int trace_enabled;
+
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct {
+	FILE *file;
+	char *path;
+	int flags;
+	uint64_t session;
+	unsigned long num_telexes;
+
+	/* open addressing, by start address */
+	struct trace_doc *docs;
+	size_t num_docs;
+	size_t num_slots;
+} trace;
+
+static size_t doc_slot(const char *start, const size_t num_slots)
+{
+	uint64_t hash;
+
+	hash = (uint64_t)(uintptr_t)start * 0x9e3779b97f4a7c15ULL;
+	return (size_t)(hash >> 32) & (num_slots - 1);
+}
+
+static int docs_grow(void)
+{
+	struct trace_doc *docs;
+	size_t num_slots;
+	size_t i;
+
+	num_slots = trace.num_slots ? trace.num_slots * 2 : 64;
+
+	if (!(docs = calloc(num_slots, sizeof(*docs)))) {
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < trace.num_slots; i++) {
+		size_t slot;
+
+		if (!trace.docs[i].id) {
+			continue;
+		}
+
+		for (slot = doc_slot(trace.docs[i].start, num_slots); docs[slot].id;
+		     slot = (slot + 1) & (num_slots - 1));
+
+		docs[slot] = trace.docs[i];
+	}
+
+	free(trace.docs);
+	trace.docs = docs;
+	trace.num_slots = num_slots;
+
+	return 0;
+}
+
+static void write_snapshot(const unsigned long id, const char *start, const size_t size)
+{
+	char *path;
+	FILE *file;
+
+	if (!(path = malloc(strlen(trace.path) + 32))) {
+		return;
+	}
+
+	sprintf(path, "%s.%lu", trace.path, id);
+
+	if ((file = fopen(path, "w"))) {
+		fwrite(start, 1, size, file);
+		fclose(file);
+	}
+
+	free(path);
+}
+
+static unsigned long doc_id(const char *start, const size_t size)
+{
+	size_t slot;
+
+	if (!trace.num_slots && docs_grow() < 0) {
+		return 0;
+	}
+
+	for (slot = doc_slot(start, trace.num_slots); trace.docs[slot].id;
+	     slot = (slot + 1) & (trace.num_slots - 1)) {
+		if (trace.docs[slot].start == start && trace.docs[slot].size == size) {
+			return trace.docs[slot].id;
+		}
+	}
+
+	if ((trace.num_docs + 1) * 2 > trace.num_slots) {
+		if (docs_grow() < 0) {
+			return 0;
+		}
+
+		return doc_id(start, size);
+	}
+
+	trace.docs[slot].start = start;
+	trace.docs[slot].size = size;
+	trace.docs[slot].id = ++trace.num_docs;
+
+	fprintf(trace.file, "D %lu %zu\n", trace.docs[slot].id, size);
+
+	if (trace.flags & TELEX_TRACE_DOCUMENTS) {
+		write_snapshot(trace.docs[slot].id, start, size);
+	}
+
+	return trace.docs[slot].id;
+}
+
+static void write_parse(const unsigned long id, const char *input, const size_t len)
+{
+	fprintf(trace.file, "P %lu %zu\n", id, len);
+	fwrite(input, 1, len, trace.file);
+	fputc('\n', trace.file);
+}
+
+static unsigned long telex_id(struct telex *telex)
+{
+	uint64_t id;
+	char *str;
+	int len;
+
+	id = atomic_load_explicit(&telex->trace_id, memory_order_relaxed);
+
+	if (id >> 32 == trace.session) {
+		return (unsigned long)(id & UINT32_MAX);
+	}
+
+	/* telexes that were parsed before the trace started are recorded as strings */
+	id = ++trace.num_telexes;
+	atomic_store_explicit(&telex->trace_id, trace.session << 32 | id, memory_order_relaxed);
+
+	if ((len = telex_to_string(telex, NULL, 0)) >= 0 && (str = malloc(len + 1))) {
+		telex_to_string(telex, str, len + 1);
+		write_parse(id, str, len);
+		free(str);
+	}
+
+	return (unsigned long)id;
+}
+
+static void write_offset(const char *start, const char *pos, const char separator)
+{
+	if (pos) {
+		fprintf(trace.file, "%zu%c", (size_t)(pos - start), separator);
+	} else {
+		fprintf(trace.file, "-%c", separator);
+	}
+}
+
+int telex_trace_start(const char *path, const int flags)
+{
+	int err;
+
+	if (!path) {
+		return -EINVAL;
+	}
+
+	pthread_mutex_lock(&trace_lock);
+
+	if (trace.file) {
+		err = -EALREADY;
+		goto cleanup;
+	}
+
+	if (!(trace.path = strdup(path))) {
+		err = -ENOMEM;
+		goto cleanup;
+	}
+
+	if (!(trace.file = fopen(path, "w"))) {
+		err = -errno;
+		free(trace.path);
+		trace.path = NULL;
+		goto cleanup;
+	}
+
+	fprintf(trace.file, "telex-trace %d\n", TRACE_VERSION);
+
+	trace.flags = flags;
+	trace.session++;
+	trace.num_telexes = 0;
+	atomic_store_explicit(&trace_enabled, 1, memory_order_relaxed);
+	err = 0;
+
+cleanup:
+	pthread_mutex_unlock(&trace_lock);
+	return err;
+}
+
+void telex_trace_stop(void)
+{
+	pthread_mutex_lock(&trace_lock);
+
+	atomic_store_explicit(&trace_enabled, 0, memory_order_relaxed);
+
+	if (trace.file) {
+		fclose(trace.file);
+		trace.file = NULL;
+	}
+
+	free(trace.path);
+	free(trace.docs);
+	trace.path = NULL;
+	trace.docs = NULL;
+	trace.num_docs = 0;
+	trace.num_slots = 0;
+
+	pthread_mutex_unlock(&trace_lock);
+}
+
+void trace_parse(const char *input, struct telex *telex)
+{
+	uint64_t id;
+
+	pthread_mutex_lock(&trace_lock);
+
+	if (trace.file) {
+		id = 0;
+
+		if (telex) {
+			id = ++trace.num_telexes;
+			atomic_store_explicit(&telex->trace_id, trace.session << 32 | id,
+					      memory_order_relaxed);
+		}
+
+		write_parse((unsigned long)id, input, strlen(input));
+	}
+
+	pthread_mutex_unlock(&trace_lock);
+}
+
+void trace_lookup(struct telex *telex, const char *start, const size_t size,
+		  const char *pos, const char *result)
+{
+	unsigned long telex_number;
+	unsigned long doc_number;
+
+	pthread_mutex_lock(&trace_lock);
+
+	if (trace.file && (doc_number = doc_id(start, size))) {
+		telex_number = telex_id(telex);
+
+		fprintf(trace.file, "L %lu %lu ", telex_number, doc_number);
+		write_offset(start, pos, ' ');
+		write_offset(start, result, '\n');
+	}
+
+	pthread_mutex_unlock(&trace_lock);
+}
+
+void trace_lookup_limited(struct telex *telex, const char *start, const size_t size,
+			  const char *pos, const struct telex_limits *limits, const int err,
+			  const char *result)
+{
+	unsigned long telex_number;
+	unsigned long doc_number;
+
+	pthread_mutex_lock(&trace_lock);
+
+	if (trace.file && (doc_number = doc_id(start, size))) {
+		telex_number = telex_id(telex);
+
+		fprintf(trace.file, "M %lu %lu ", telex_number, doc_number);
+		write_offset(start, pos, ' ');
+		fprintf(trace.file, "%zu %zu %d ", limits ? limits->max_bytes : 0,
+			limits ? limits->max_lines : 0, err);
+		write_offset(start, err < 0 ? NULL : result, '\n');
+	}
+
+	pthread_mutex_unlock(&trace_lock);
+}
+
+void trace_lookup_array(struct telex **telexes, const size_t n, const char *start,
+			const size_t size, const char *pos, const char *result)
+{
+	unsigned long doc_number;
+	size_t i;
+
+	pthread_mutex_lock(&trace_lock);
+
+	if (trace.file && (doc_number = doc_id(start, size))) {
+		/* telexes seen the first time are written before the record that uses them */
+		for (i = 0; i < n; i++) {
+			telex_id(telexes[i]);
+		}
+
+		fprintf(trace.file, "A %lu ", doc_number);
+		write_offset(start, pos, ' ');
+		write_offset(start, result, ' ');
+		fprintf(trace.file, "%zu", n);
+
+		for (i = 0; i < n; i++) {
+			fprintf(trace.file, " %lu", telex_id(telexes[i]));
+		}
+
+		fputc('\n', trace.file);
+	}
+
+	pthread_mutex_unlock(&trace_lock);
+}
+
+void trace_lookup_range(struct telex_range *range, const char *start, const size_t size,
+			const char *pos, const int err, const struct telex_span *span)
+{
+	unsigned long start_number;
+	unsigned long end_number;
+	unsigned long doc_number;
+
+	pthread_mutex_lock(&trace_lock);
+
+	if (trace.file && (doc_number = doc_id(start, size))) {
+		start_number = telex_id(range->start);
+		end_number = telex_id(range->end);
+
+		fprintf(trace.file, "R %lu %lu %lu ", start_number, end_number, doc_number);
+		write_offset(start, pos, ' ');
+		fprintf(trace.file, "%d ", err);
+		write_offset(start, err < 0 ? NULL : span->begin, ' ');
+		write_offset(start, err < 0 ? NULL : span->end, '\n');
+	}
+
+	pthread_mutex_unlock(&trace_lock);
+}
@@ -0,0 +1,51 @@
+/*
+ * trace.h - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <telex/trace.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+struct telex;
+struct telex_limits;
+struct telex_range;
+struct telex_span;
+
+extern atomic_int trace_enabled;
+
+static inline int trace_active(void)
+{
+	return atomic_load_explicit(&trace_enabled, memory_order_relaxed);
+}
+
+void trace_parse(const char *input, struct telex *telex);
+void trace_lookup(struct telex *telex, const char *start, const size_t size,
+		  const char *pos, const char *result);
+void trace_lookup_limited(struct telex *telex, const char *start, const size_t size,
+			  const char *pos, const struct telex_limits *limits, const int err,
+			  const char *result);
+void trace_lookup_array(struct telex **telexes, const size_t n, const char *start,
+			const size_t size, const char *pos, const char *result);
+void trace_lookup_range(struct telex_range *range, const char *start, const size_t size,
+			const char *pos, const int err, const struct telex_span *span);
+
+#endif /* TRACE_H */
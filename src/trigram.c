@@ -0,0 +1,699 @@
+/*
+ * trigram.c - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "trigram.h"
+
+/*
+ * The document is divided into blocks of TRIGRAM_BLOCK_SIZE bytes, and for
+ * each trigram we keep a sorted list of the blocks it starts in. Trigrams
+ * are hashed into a fixed number of buckets; a collision only makes a block
+ * show up as a candidate when it isn't one, it never hides a match.
+ *
+ * Posting lists are appended to in memory. When they grow beyond the
+ * memory limit, they are written to the spill file as a segment and the
+ * file is mapped back into memory. Since blocks are indexed in order, the
+ * segments and the in-memory lists are sorted with respect to each other.
+ */
+
+#define TRIGRAM_BUCKETS  (1 << 16)
+#define TRIGRAM_MAX_KEYS 16
+
+/* each segment carries an offset table, so spilling tiny segments is wasteful */
+#define TRIGRAM_MIN_MEMORY_LIMIT (1024 * 1024)
+
+struct posting_list {
+	uint32_t *blocks;
+	uint32_t count;
+	uint32_t capacity;
+};
+
+struct trigram_index {
+	struct posting_list *lists;
+	size_t memory_used;
+	size_t memory_limit;
+
+	size_t next_trigram;
+
+	char *spill_path;
+	int spill_fd;
+	unsigned char *spill_map;
+	size_t spill_size;
+	size_t *segments;
+	size_t num_segments;
+};
+
+struct posting_view {
+	const uint32_t *blocks;
+	size_t count;
+};
+
+static uint32_t trigram_bucket(const unsigned char *text)
+{
+	uint32_t trigram;
+
+	trigram = (uint32_t)text[0] << 16 | (uint32_t)text[1] << 8 | text[2];
+	return (trigram * 2654435761U) >> 16;
+}
+
+int trigram_index_new(struct trigram_index **index, const size_t memory_limit,
+		      const char *spill_path)
+{
+	struct trigram_index *new;
+
+	if (!index) {
+		return -EINVAL;
+	}
+
+	if (!(new = calloc(1, sizeof(*new)))) {
+		return -ENOMEM;
+	}
+
+	new->spill_fd = -1;
+	new->memory_limit = memory_limit;
+
+	if (memory_limit && memory_limit < TRIGRAM_MIN_MEMORY_LIMIT) {
+		new->memory_limit = TRIGRAM_MIN_MEMORY_LIMIT;
+	}
+
+	if (!(new->lists = calloc(TRIGRAM_BUCKETS, sizeof(*new->lists))) ||
+	    (spill_path && !(new->spill_path = strdup(spill_path)))) {
+		trigram_index_free(&new);
+		return -ENOMEM;
+	}
+
+	*index = new;
+	return 0;
+}
+
+static void trigram_index_clear_lists(struct trigram_index *index)
+{
+	size_t i;
+
+	for (i = 0; i < TRIGRAM_BUCKETS; i++) {
+		free(index->lists[i].blocks);
+	}
+
+	memset(index->lists, 0, TRIGRAM_BUCKETS * sizeof(*index->lists));
+	index->memory_used = 0;
+}
+
+void trigram_index_free(struct trigram_index **index)
+{
+	if (index && *index) {
+		if ((*index)->lists) {
+			trigram_index_clear_lists(*index);
+			free((*index)->lists);
+		}
+
+		if ((*index)->spill_map) {
+			munmap((*index)->spill_map, (*index)->spill_size);
+		}
+
+		if ((*index)->spill_fd >= 0) {
+			close((*index)->spill_fd);
+			unlink((*index)->spill_path);
+		}
+
+		free((*index)->segments);
+		free((*index)->spill_path);
+		free(*index);
+		*index = NULL;
+	}
+}
+
+static int write_all(int fd, const void *data, size_t size, off_t offset)
+{
+	const char *cur;
+
+	cur = data;
+
+	while (size > 0) {
+		ssize_t written;
+
+		if ((written = pwrite(fd, cur, size, offset)) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			return -errno;
+		}
+
+		cur += written;
+		offset += written;
+		size -= written;
+	}
+
+	return 0;
+}
+
+static int trigram_index_spill(struct trigram_index *index)
+{
+	uint32_t *offsets;
+	size_t *segments;
+	size_t segment_size;
+	off_t offset;
+	void *map;
+	size_t i;
+	int err;
+
+	if (!index->spill_path) {
+		return -ENOSPC;
+	}
+
+	if (index->spill_fd < 0 &&
+	    (index->spill_fd = open(index->spill_path, O_RDWR | O_CREAT | O_TRUNC, 0600)) < 0) {
+		return -errno;
+	}
+
+	if (!(segments = realloc(index->segments,
+				 (index->num_segments + 1) * sizeof(*segments)))) {
+		return -ENOMEM;
+	}
+	index->segments = segments;
+
+	if (!(offsets = malloc((TRIGRAM_BUCKETS + 1) * sizeof(*offsets)))) {
+		return -ENOMEM;
+	}
+
+	offsets[0] = 0;
+	for (i = 0; i < TRIGRAM_BUCKETS; i++) {
+		offsets[i + 1] = offsets[i] + index->lists[i].count;
+	}
+
+	segment_size = (TRIGRAM_BUCKETS + 1) * sizeof(*offsets) +
+		offsets[TRIGRAM_BUCKETS] * sizeof(uint32_t);
+
+	/*
+	 * Segments are written at explicit offsets, so that a write that fails
+	 * halfway doesn't move the place where the next spill starts.
+	 */
+	offset = index->spill_size;
+
+	if ((err = write_all(index->spill_fd, offsets,
+			     (TRIGRAM_BUCKETS + 1) * sizeof(*offsets), offset)) < 0) {
+		goto cleanup;
+	}
+	offset += (TRIGRAM_BUCKETS + 1) * sizeof(*offsets);
+
+	for (i = 0; i < TRIGRAM_BUCKETS; i++) {
+		if ((err = write_all(index->spill_fd, index->lists[i].blocks,
+				     index->lists[i].count * sizeof(uint32_t), offset)) < 0) {
+			goto cleanup;
+		}
+		offset += index->lists[i].count * sizeof(uint32_t);
+	}
+
+	if (ftruncate(index->spill_fd, index->spill_size + segment_size) < 0) {
+		err = -errno;
+		goto cleanup;
+	}
+
+	if (index->spill_map) {
+		munmap(index->spill_map, index->spill_size);
+		index->spill_map = NULL;
+	}
+
+	map = mmap(NULL, index->spill_size + segment_size, PROT_READ, MAP_SHARED,
+		   index->spill_fd, 0);
+
+	if (map == MAP_FAILED) {
+		err = -errno;
+		goto cleanup;
+	}
+
+	index->spill_map = map;
+	index->segments[index->num_segments++] = index->spill_size;
+	index->spill_size += segment_size;
+	trigram_index_clear_lists(index);
+
+cleanup:
+	free(offsets);
+	return err;
+}
+
+static int posting_list_add(struct trigram_index *index, const uint32_t bucket,
+			    const uint32_t block)
+{
+	struct posting_list *list;
+
+	list = &index->lists[bucket];
+
+	if (list->count > 0 && list->blocks[list->count - 1] == block) {
+		return 0;
+	}
+
+	if (list->count == list->capacity) {
+		uint32_t *blocks;
+		uint32_t capacity;
+
+		capacity = list->capacity ? list->capacity * 2 : 4;
+
+		if (!(blocks = realloc(list->blocks, capacity * sizeof(*blocks)))) {
+			return -ENOMEM;
+		}
+
+		index->memory_used += (capacity - list->capacity) * sizeof(*blocks);
+		list->blocks = blocks;
+		list->capacity = capacity;
+	}
+
+	list->blocks[list->count++] = block;
+	return 0;
+}
+
+int trigram_index_update(struct trigram_index *index, const char *text,
+			 const size_t size, const size_t max_bytes)
+{
+	const unsigned char *utext;
+	size_t end;
+	size_t pos;
+	int err;
+
+	if (!index || !text) {
+		return -EINVAL;
+	}
+
+	if (size < 3) {
+		return 0;
+	}
+
+	utext = (const unsigned char*)text;
+	end = size - 2;
+
+	if (max_bytes && end - index->next_trigram > max_bytes) {
+		end = index->next_trigram + max_bytes;
+	}
+
+	for (pos = index->next_trigram; pos < end; pos++) {
+		if ((err = posting_list_add(index, trigram_bucket(utext + pos),
+					    pos / TRIGRAM_BLOCK_SIZE)) < 0) {
+			index->next_trigram = pos;
+			return err;
+		}
+
+		if (index->memory_limit && index->memory_used > index->memory_limit &&
+		    (err = trigram_index_spill(index)) < 0) {
+			index->next_trigram = pos + 1;
+			return err;
+		}
+	}
+
+	index->next_trigram = end;
+
+	/* positive if there is more to do */
+	return end < size - 2;
+}
+
+size_t trigram_index_indexed(struct trigram_index *index)
+{
+	return index ? index->next_trigram : 0;
+}
+
+static size_t trigram_index_views(struct trigram_index *index, const uint32_t bucket,
+				  struct posting_view *views)
+{
+	size_t num_views;
+	size_t i;
+
+	num_views = 0;
+
+	for (i = 0; i < index->num_segments; i++) {
+		const uint32_t *offsets;
+		const uint32_t *postings;
+
+		offsets = (const uint32_t*)(index->spill_map + index->segments[i]);
+		postings = (const uint32_t*)(offsets + TRIGRAM_BUCKETS + 1);
+
+		if (offsets[bucket + 1] > offsets[bucket]) {
+			views[num_views].blocks = postings + offsets[bucket];
+			views[num_views].count = offsets[bucket + 1] - offsets[bucket];
+			num_views++;
+		}
+	}
+
+	if (index->lists[bucket].count > 0) {
+		views[num_views].blocks = index->lists[bucket].blocks;
+		views[num_views].count = index->lists[bucket].count;
+		num_views++;
+	}
+
+	return num_views;
+}
+
+/* smallest block >= `block' that contains the trigram, or -1 */
+static int64_t posting_seek(struct trigram_index *index, const uint32_t bucket,
+			    const uint32_t block)
+{
+	struct posting_view views[index->num_segments + 1];
+	size_t num_views;
+	size_t i;
+
+	num_views = trigram_index_views(index, bucket, views);
+
+	for (i = 0; i < num_views; i++) {
+		size_t low;
+		size_t high;
+
+		if (views[i].blocks[views[i].count - 1] < block) {
+			continue;
+		}
+
+		low = 0;
+		high = views[i].count;
+
+		while (low < high) {
+			size_t mid;
+
+			mid = low + (high - low) / 2;
+
+			if (views[i].blocks[mid] < block) {
+				low = mid + 1;
+			} else {
+				high = mid;
+			}
+		}
+
+		return views[i].blocks[low];
+	}
+
+	return -1;
+}
+
+/* largest block <= `block' that contains the trigram, or -1 */
+static int64_t posting_seek_back(struct trigram_index *index, const uint32_t bucket,
+				 const uint32_t block)
+{
+	struct posting_view views[index->num_segments + 1];
+	size_t num_views;
+
+	num_views = trigram_index_views(index, bucket, views);
+
+	while (num_views-- > 0) {
+		struct posting_view *view;
+		size_t low;
+		size_t high;
+
+		view = &views[num_views];
+
+		if (view->blocks[0] > block) {
+			continue;
+		}
+
+		low = 0;
+		high = view->count;
+
+		while (low < high) {
+			size_t mid;
+
+			mid = low + (high - low) / 2;
+
+			if (view->blocks[mid] <= block) {
+				low = mid + 1;
+			} else {
+				high = mid;
+			}
+		}
+
+		return view->blocks[low - 1];
+	}
+
+	return -1;
+}
+
+static size_t needle_buckets(const char *needle, const size_t len, uint32_t *buckets)
+{
+	size_t num_buckets;
+	size_t limit;
+	size_t i;
+
+	/*
+	 * Only trigrams that start within one block of the match can be relied
+	 * upon to be found in the block the match starts in, or the next one.
+	 */
+	limit = len < TRIGRAM_BLOCK_SIZE ? len : TRIGRAM_BLOCK_SIZE;
+	num_buckets = 0;
+
+	for (i = 0; i + 3 <= limit && num_buckets < TRIGRAM_MAX_KEYS; i++) {
+		uint32_t bucket;
+		size_t j;
+
+		bucket = trigram_bucket((const unsigned char*)needle + i);
+
+		for (j = 0; j < num_buckets && buckets[j] != bucket; j++);
+
+		if (j == num_buckets) {
+			buckets[num_buckets++] = bucket;
+		}
+	}
+
+	return num_buckets;
+}
+
+/*
+ * A match may start in block b only if every trigram of the needle
+ * occurs in block b or b + 1.
+ */
+static int64_t next_candidate(struct trigram_index *index, const uint32_t *buckets,
+			      const size_t num_buckets, int64_t block)
+{
+	size_t i;
+
+restart:
+	for (i = 0; i < num_buckets; i++) {
+		int64_t found;
+
+		if ((found = posting_seek(index, buckets[i], block)) < 0) {
+			return -1;
+		}
+
+		if (found > block + 1) {
+			block = found - 1;
+			goto restart;
+		}
+	}
+
+	return block;
+}
+
+static int64_t prev_candidate(struct trigram_index *index, const uint32_t *buckets,
+			      const size_t num_buckets, int64_t block)
+{
+	size_t i;
+
+restart:
+	for (i = 0; i < num_buckets; i++) {
+		int64_t found;
+
+		if ((found = posting_seek_back(index, buckets[i], block + 1)) < 0) {
+			return -1;
+		}
+
+		if (found < block) {
+			block = found;
+			goto restart;
+		}
+	}
+
+	return block;
+}
+
+/* last match that starts in text[first, last]; adds the bytes it compared to *scanned */
+static const char* find_last(const char *text, const size_t size, size_t first,
+			     size_t last, const char *needle, const size_t len, size_t *scanned)
+{
+	size_t end;
+
+	if (len > size) {
+		return NULL;
+	}
+
+	if (last > size - len) {
+		last = size - len;
+	}
+
+	end = last + len;
+
+	while (last + 1 > first) {
+		const char *candidate;
+
+		if (!(candidate = memrchr(text + first, needle[0], last - first + 1))) {
+			break;
+		}
+
+		if (memcmp(candidate, needle, len) == 0) {
+			*scanned += text + end - candidate;
+			return candidate;
+		}
+
+		if (candidate == text + first) {
+			break;
+		}
+
+		last = candidate - text - 1;
+	}
+
+	*scanned += end > first ? end - first : 0;
+	return NULL;
+}
+
+/* start of the first region that has not been indexed for a needle of this length */
+static size_t unindexed_start(struct trigram_index *index, const size_t len)
+{
+	return index->next_trigram + 2 >= len ? index->next_trigram + 2 - len : 0;
+}
+
+/* the part of text[first, end) that memmem() compared to find the match */
+static const char* find_first(const char *text, const size_t first, const size_t end,
+			      const char *needle, const size_t len, size_t *scanned)
+{
+	const char *match;
+
+	if (end <= first) {
+		return NULL;
+	}
+
+	if ((match = memmem(text + first, end - first, needle, len))) {
+		*scanned += match + len - (text + first);
+	} else {
+		*scanned += end - first;
+	}
+
+	return match;
+}
+
+const char* trigram_index_find(struct trigram_index *index, const char *text,
+			       const size_t size, const char *pos,
+			       const char *needle, const size_t len, size_t *scanned)
+{
+	uint32_t buckets[TRIGRAM_MAX_KEYS];
+	size_t num_buckets;
+	size_t tail;
+	size_t offset;
+	int64_t block;
+
+	if (!index || !text || !pos || !needle || !len) {
+		return NULL;
+	}
+
+	offset = pos - text;
+	num_buckets = needle_buckets(needle, len, buckets);
+	tail = num_buckets ? unindexed_start(index, len) : 0;
+
+	for (block = offset / TRIGRAM_BLOCK_SIZE;
+	     (size_t)block * TRIGRAM_BLOCK_SIZE < tail;
+	     block++) {
+		const char *match;
+		size_t first;
+		size_t end;
+
+		if ((block = next_candidate(index, buckets, num_buckets, block)) < 0 ||
+		    (size_t)block * TRIGRAM_BLOCK_SIZE >= tail) {
+			break;
+		}
+
+		first = (size_t)block * TRIGRAM_BLOCK_SIZE;
+		if (first < offset) {
+			first = offset;
+		}
+
+		end = ((size_t)block + 1) * TRIGRAM_BLOCK_SIZE;
+		if (end > tail) {
+			end = tail;
+		}
+		end += len - 1;
+		if (end > size) {
+			end = size;
+		}
+
+		if ((match = find_first(text, first, end, needle, len, scanned))) {
+			return match;
+		}
+	}
+
+	if (tail < offset) {
+		tail = offset;
+	}
+
+	return find_first(text, tail, size, needle, len, scanned);
+}
+
+const char* trigram_index_rfind(struct trigram_index *index, const char *text,
+				const size_t size, const char *pos,
+				const char *needle, const size_t len, size_t *scanned)
+{
+	uint32_t buckets[TRIGRAM_MAX_KEYS];
+	size_t num_buckets;
+	size_t tail;
+	size_t offset;
+	const char *match;
+	int64_t block;
+
+	if (!index || !text || !pos || !needle || !len) {
+		return NULL;
+	}
+
+	offset = pos - text;
+	num_buckets = needle_buckets(needle, len, buckets);
+	tail = num_buckets ? unindexed_start(index, len) : 0;
+
+	if (offset >= tail &&
+	    (match = find_last(text, size, tail, offset, needle, len, scanned))) {
+		return match;
+	}
+
+	if (!tail) {
+		return NULL;
+	}
+
+	for (block = (offset < tail ? offset : tail - 1) / TRIGRAM_BLOCK_SIZE;
+	     block >= 0;
+	     block--) {
+		size_t first;
+		size_t last;
+
+		if ((block = prev_candidate(index, buckets, num_buckets, block)) < 0) {
+			break;
+		}
+
+		first = (size_t)block * TRIGRAM_BLOCK_SIZE;
+		last = first + TRIGRAM_BLOCK_SIZE - 1;
+
+		if (last >= tail) {
+			last = tail - 1;
+		}
+		if (last > offset) {
+			last = offset;
+		}
+
+		if ((match = find_last(text, size, first, last, needle, len, scanned))) {
+			return match;
+		}
+	}
+
+	return NULL;
+}
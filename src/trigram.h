@@ -0,0 +1,46 @@
+/*
+ * trigram.h - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef TRIGRAM_H
+#define TRIGRAM_H
+
+#include <stddef.h>
+
+#define TRIGRAM_BLOCK_SIZE (32 * 1024)
+
+struct trigram_index;
+
+int trigram_index_new(struct trigram_index **index, const size_t memory_limit,
+		      const char *spill_path);
+void trigram_index_free(struct trigram_index **index);
+
+int trigram_index_update(struct trigram_index *index, const char *text,
+			 const size_t size, const size_t max_bytes);
+size_t trigram_index_indexed(struct trigram_index *index);
+
+/* both add the number of bytes they compared to *scanned */
+const char* trigram_index_find(struct trigram_index *index, const char *text,
+			       const size_t size, const char *pos,
+			       const char *needle, const size_t len, size_t *scanned);
+const char* trigram_index_rfind(struct trigram_index *index, const char *text,
+				const size_t size, const char *pos,
+				const char *needle, const size_t len, size_t *scanned);
+
+#endif /* TRIGRAM_H */
@@ -0,0 +1,127 @@
+/*
+ * anchors.c - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Adds and removes anchors the way an editor does while the user moves
+ * around, and checks that the steps of removed anchors are released.
+ */
+
+#include <telex/telex.h>
+#include <telex/anchors.h>
+#include <telex/error.h>
+#include <errno.h>
+#include <stdio.h>
+
+#define ROUNDS   100
+#define ANCHORS  64
+
+static int add_anchor(struct telex_anchors *anchors, const char *input)
+{
+	struct telex_error *errors;
+	struct telex *telex;
+	int id;
+
+	errors = NULL;
+	telex = NULL;
+
+	if (telex_parse(&telex, input, &errors) < 0) {
+		telex_error_free_all(&errors);
+		return -1;
+	}
+
+	id = telex_anchors_add(anchors, telex, 0);
+	telex_free(&telex);
+
+	return id;
+}
+
+int main(void)
+{
+	struct telex_anchors *anchors;
+	struct telex_doc *doc;
+	char text[4096];
+	int ids[ANCHORS];
+	char input[64];
+	size_t shared;
+	int round;
+	int failed;
+	int i;
+
+	anchors = NULL;
+	doc = NULL;
+	failed = 0;
+
+	for (i = 0; i < sizeof(text) - 1; i++) {
+		text[i] = i % 32 == 31 ? '\n' : 'a' + i % 7;
+	}
+	text[i] = 0;
+
+	if (telex_anchors_new(&anchors) < 0 || telex_doc_new(&doc, text, i) < 0) {
+		return 1;
+	}
+
+	/* a long-lived anchor whose steps are shared with all others */
+	if (add_anchor(anchors, ":10>\"a\"") < 0) {
+		return 1;
+	}
+
+	shared = telex_anchors_num_nodes(anchors);
+
+	for (round = 0; round < ROUNDS && !failed; round++) {
+		for (i = 0; i < ANCHORS; i++) {
+			snprintf(input, sizeof(input), ":10>\"a\">\"%d-%d\">%d", round, i, i);
+
+			if ((ids[i] = add_anchor(anchors, input)) < 0) {
+				fprintf(stderr, "could not add %s\n", input);
+				failed = 1;
+				break;
+			}
+		}
+
+		if (!failed && telex_anchors_num_nodes(anchors) != shared + 2 * ANCHORS) {
+			fprintf(stderr, "round %d: %zu nodes after adding, expected %zu\n",
+				round, telex_anchors_num_nodes(anchors), shared + 2 * ANCHORS);
+			failed = 1;
+		}
+
+		telex_anchors_resolve(anchors, doc);
+
+		while (--i >= 0) {
+			if (telex_anchors_remove(anchors, ids[i]) < 0 ||
+			    telex_anchors_remove(anchors, ids[i]) != -EINVAL) {
+				fprintf(stderr, "round %d: could not remove anchor %d\n", round, ids[i]);
+				failed = 1;
+			}
+		}
+
+		if (telex_anchors_num_nodes(anchors) != shared) {
+			fprintf(stderr, "round %d: %zu nodes after removing, expected %zu\n",
+				round, telex_anchors_num_nodes(anchors), shared);
+			failed = 1;
+		}
+	}
+
+	telex_anchors_resolve(anchors, doc);
+	telex_anchors_free(&anchors);
+	telex_doc_free(&doc);
+
+	printf("anchors: %s\n", failed ? "FAIL" : "OK");
+	return failed;
+}
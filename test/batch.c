@@ -0,0 +1,124 @@
+/*
+ * batch.c - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Looks up telexes with and without prefixes in many documents at once and
+ * checks that every cell of the batch agrees with telex_lookup().
+ */
+
+#include <telex/telex.h>
+#include <telex/error.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define NUM_DOCS    40
+#define NUM_THREADS 4
+#define DOC_SIZE    4096
+
+static const char *inputs[] = {
+	">\"needle\"",
+	">:100",
+	":3",
+	"\"needle\">#2",
+	"<<\"needle\"",
+	"\"missing\""
+};
+
+#define NUM_TELEXES (sizeof(inputs) / sizeof(inputs[0]))
+
+int main(void)
+{
+	struct telex_batch_result results[NUM_DOCS * NUM_TELEXES];
+	struct telex_batch_doc docs[NUM_DOCS];
+	struct telex *telexes[NUM_TELEXES];
+	struct telex_error *errors;
+	static char texts[NUM_DOCS][DOC_SIZE];
+	char path[] = "/tmp/telex-batch-XXXXXX";
+	int failed;
+	size_t size;
+	size_t i;
+	size_t j;
+	int fd;
+
+	errors = NULL;
+	failed = 0;
+
+	for (i = 0; i < NUM_TELEXES; i++) {
+		if (telex_parse(&telexes[i], inputs[i], &errors) < 0) {
+			fprintf(stderr, "could not parse %s\n", inputs[i]);
+			return 1;
+		}
+	}
+
+	for (i = 0; i < NUM_DOCS; i++) {
+		size = 0;
+
+		for (j = 0; size + 32 < DOC_SIZE; j++) {
+			size += snprintf(texts[i] + size, DOC_SIZE - size, "%s %zu\n",
+					 (i + j) % 17 == 0 ? "needle" : "hay", j);
+		}
+
+		docs[i].path = NULL;
+		docs[i].start = texts[i];
+		docs[i].size = size;
+	}
+
+	/* the last document is read from a file */
+	if ((fd = mkstemp(path)) < 0 ||
+	    write(fd, docs[NUM_DOCS - 1].start, docs[NUM_DOCS - 1].size) < 0) {
+		perror(path);
+		return 1;
+	}
+	close(fd);
+	docs[NUM_DOCS - 1].path = path;
+
+	if (telex_batch_lookup(telexes, NUM_TELEXES, docs, NUM_DOCS, results, NUM_THREADS) < 0) {
+		fprintf(stderr, "batch lookup failed\n");
+		failed = 1;
+	}
+
+	for (i = 0; i < NUM_DOCS && !failed; i++) {
+		for (j = 0; j < NUM_TELEXES; j++) {
+			struct telex_batch_result *result;
+			const char *expected;
+
+			result = &results[i * NUM_TELEXES + j];
+			expected = telex_lookup(telexes[j], texts[i], docs[i].size, texts[i]);
+
+			if (expected ? result->error < 0 || result->offset != expected - texts[i] :
+			    result->error >= 0) {
+				fprintf(stderr, "document %zu: %s gave %d/%zu, expected %ld\n",
+					i, inputs[j], result->error, result->offset,
+					expected ? (long)(expected - texts[i]) : -1L);
+				failed = 1;
+			}
+		}
+	}
+
+	unlink(path);
+
+	for (i = 0; i < NUM_TELEXES; i++) {
+		telex_free(&telexes[i]);
+	}
+
+	printf("batch: %s\n", failed ? "FAIL" : "OK");
+	return failed;
+}
@@ -0,0 +1,168 @@
+/*
+ * cache.c - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Edits a document whose lookups are cached and checks that the cached
+ * lookups find the same positions as uncached ones after every edit.
+ */
+
+#include <telex/telex.h>
+#include <telex/error.h>
+#include <stdio.h>
+#include <string.h>
+
+#define LINES  64
+#define AT_END ((size_t)-1)
+
+struct cache_edit {
+	const char *name;
+	size_t offset;
+	size_t removed_len;
+	const char *inserted;
+};
+
+static const char *inputs[] = {
+	":3",
+	":40",
+	":7>#5",
+	"\"needle\"",
+	"2*\"needle\"",
+	":20>\"needle\"",
+	":30<\"needle\"",
+	"\"hay\"@2",
+	">\"nothing\"|\"needle\"",
+	">:2>\"needle\"",
+	"<\"needle\""
+};
+
+#define NUM_TELEXES (sizeof(inputs) / sizeof(inputs[0]))
+
+static const struct cache_edit edits[] = {
+	{ "insert before", 0,    0,  "xyz" },
+	{ "delete across", 100,  60, "" },
+	{ "append",        AT_END, 0, "needle at the end" },
+	{ "insert newline", 400, 0,  "\n" },
+	{ "replace",       200,  10, "needle\nneedle" },
+	{ "delete line",   0,    40, "" }
+};
+
+#define NUM_EDITS (sizeof(edits) / sizeof(edits[0]))
+
+static char text[8192];
+static size_t size;
+
+static int compare(struct telex_doc *doc, struct telex **telexes, const char *when)
+{
+	int failed;
+	size_t i;
+	int pass;
+
+	failed = 0;
+
+	/*
+	 * The first two passes fill the cache, or continue the lookups that an
+	 * edit invalidated, and the other two hit it. Lookups from the fixed
+	 * offset also find entries that were shifted by the edit.
+	 */
+	for (pass = 0; pass < 4; pass++) {
+		for (i = 0; i < NUM_TELEXES; i++) {
+			const char *pos;
+			const char *cached;
+			const char *expected;
+
+			pos = text + (pass & 1 ? size / 2 : 300);
+			cached = telex_doc_lookup(doc, telexes[i], pos);
+			expected = telex_lookup(telexes[i], text, size, pos);
+
+			if (cached != expected) {
+				fprintf(stderr, "%s, pass %d: %s found %ld, expected %ld\n",
+					when, pass, inputs[i],
+					cached ? (long)(cached - text) : -1L,
+					expected ? (long)(expected - text) : -1L);
+				failed = 1;
+			}
+		}
+	}
+
+	return failed;
+}
+
+int main(void)
+{
+	struct telex *telexes[NUM_TELEXES];
+	struct telex_error *errors;
+	struct telex_doc *doc;
+	int failed;
+	size_t i;
+
+	doc = NULL;
+	errors = NULL;
+	failed = 0;
+	size = 0;
+
+	for (i = 0; i < LINES; i++) {
+		size += snprintf(text + size, sizeof(text) - size, "%s %zu hay hay\n",
+				 i % 5 == 3 ? "needle" : "straw", i);
+	}
+
+	for (i = 0; i < NUM_TELEXES; i++) {
+		if (telex_parse(&telexes[i], inputs[i], &errors) < 0) {
+			fprintf(stderr, "could not parse %s\n", inputs[i]);
+			return 1;
+		}
+	}
+
+	if (telex_doc_new(&doc, text, size) < 0 || telex_doc_cache(doc, 64) < 0) {
+		return 1;
+	}
+
+	failed |= compare(doc, telexes, "before editing");
+
+	for (i = 0; i < NUM_EDITS; i++) {
+		const struct cache_edit *edit;
+		size_t inserted_len;
+		size_t offset;
+
+		edit = &edits[i];
+		inserted_len = strlen(edit->inserted);
+		offset = edit->offset == AT_END ? size : edit->offset;
+
+		memmove(text + offset + inserted_len, text + offset + edit->removed_len,
+			size - offset - edit->removed_len);
+		memcpy(text + offset, edit->inserted, inserted_len);
+		size = size - edit->removed_len + inserted_len;
+
+		if (telex_doc_edit(doc, text, size, offset, edit->removed_len, inserted_len) < 0) {
+			fprintf(stderr, "could not %s\n", edit->name);
+			failed = 1;
+			break;
+		}
+
+		failed |= compare(doc, telexes, edit->name);
+	}
+
+	for (i = 0; i < NUM_TELEXES; i++) {
+		telex_free(&telexes[i]);
+	}
+	telex_doc_free(&doc);
+
+	printf("cache: %s\n", failed ? "FAIL" : "OK");
+	return failed;
+}
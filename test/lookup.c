@@ -0,0 +1,326 @@
+/*
+ * lookup.c - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Looks up strings forwards and backwards, with and without case, counts
+ * and scopes, and checks the results against a plain scan of the text.
+ * The texts are made of letters, newlines, and characters that only
+ * differ from each other in the case bit, and matches are placed across
+ * the 16 and 64 byte blocks that the searches compare at once, and at
+ * the end of the text.
+ */
+
+#include <telex/telex.h>
+#include <telex/error.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define ROUNDS     4000
+#define MAX_TEXT   300
+#define MAX_NEEDLE 24
+
+struct lookup {
+	const char *prefix;
+	int backward;
+	int nocase;
+	int count;
+	int scope;
+	const char *needle;
+	size_t len;
+	size_t pos;
+};
+
+static const char alphabet[] = "aAbB@`[{\n";
+
+static uint32_t state = 0x5eed;
+
+static uint32_t next_random(void)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+static int same(const char a, const char b, const int nocase)
+{
+	if (nocase && ((a | 0x20) >= 'a' && (a | 0x20) <= 'z')) {
+		return (a | 0x20) == (b | 0x20);
+	}
+
+	return a == b;
+}
+
+static int match_at(const char *text, const size_t at, const struct lookup *lookup)
+{
+	size_t i;
+
+	for (i = 0; i < lookup->len && same(text[at + i], lookup->needle[i], lookup->nocase); i++);
+	return i == lookup->len;
+}
+
+/* the offset a lookup has to find, or -1 */
+static long reference(const char *text, const size_t size, const struct lookup *lookup)
+{
+	size_t lo;
+	size_t hi;
+	long found;
+	int lines;
+	int count;
+	size_t i;
+
+	lo = 0;
+	hi = size;
+
+	/* scopes end at the newline that starts or ends the last line they cover */
+	if (lookup->scope >= 0 && lookup->backward) {
+		for (i = lookup->pos, lines = 0; i > 0; i--) {
+			if (text[i - 1] == '\n' && lines++ == lookup->scope) {
+				lo = i;
+				break;
+			}
+		}
+	} else if (lookup->scope >= 0) {
+		for (i = lookup->pos, lines = 0; i < size; i++) {
+			if (text[i] == '\n' && lines++ == lookup->scope) {
+				hi = i;
+				break;
+			}
+		}
+	}
+
+	if (lookup->len > hi - lo) {
+		return -1;
+	}
+
+	found = -1;
+	count = lookup->count;
+
+	if (lookup->backward) {
+		/* i is one past the start that is compared next */
+		i = (lookup->pos < hi - lookup->len ? lookup->pos : hi - lookup->len) + 1;
+
+		for (; count > 0 && i > lo; i--) {
+			if (match_at(text, i - 1, lookup)) {
+				found = i - 1;
+				count--;
+
+				/* occurrences don't overlap */
+				i = i > lo + lookup->len ? i - lookup->len + 1 : lo + 1;
+			}
+		}
+	} else {
+		for (i = lookup->pos; count > 0 && i + lookup->len <= hi; i++) {
+			if (match_at(text, i, lookup)) {
+				found = i;
+				count--;
+				i += lookup->len - 1;
+			}
+		}
+	}
+
+	if (count > 0) {
+		return -1;
+	}
+
+	/* `<' and `>>' lead to the end of the match */
+	return !strcmp(lookup->prefix, "<") || !strcmp(lookup->prefix, ">>") ?
+		found + (long)lookup->len : found;
+}
+
+static int format(char *input, const size_t input_size, const struct lookup *lookup)
+{
+	size_t len;
+
+	len = snprintf(input, input_size, "%s", lookup->prefix);
+
+	if (lookup->count > 1) {
+		len += snprintf(input + len, input_size - len, "%d*", lookup->count);
+	}
+
+	input[len++] = '"';
+
+	/* strings take newlines as they are */
+	memcpy(input + len, lookup->needle, lookup->len);
+	len += lookup->len;
+	input[len++] = '"';
+	input[len] = 0;
+
+	if (lookup->nocase) {
+		len += snprintf(input + len, input_size - len, "i");
+	}
+
+	if (lookup->scope >= 0) {
+		len += snprintf(input + len, input_size - len, "@%d", lookup->scope);
+	}
+
+	return len < input_size ? 0 : -1;
+}
+
+static int check(const char *text, const size_t size, const struct lookup *lookup)
+{
+	struct telex_error *errors;
+	struct telex_eval *eval;
+	struct telex *telex;
+	const char *result;
+	const char *found;
+	char input[128];
+	long expected;
+	int failed;
+
+	errors = NULL;
+	telex = NULL;
+	eval = NULL;
+	failed = 0;
+
+	if (format(input, sizeof(input), lookup) < 0 || telex_parse(&telex, input, &errors) < 0) {
+		fprintf(stderr, "could not parse %s\n", input);
+		telex_error_free_all(&errors);
+		return 1;
+	}
+
+	expected = reference(text, size, lookup);
+	found = telex_lookup(telex, text, size, text + lookup->pos);
+
+	/* resumable lookups search in pieces that end in the middle of matches */
+	if (telex_eval_start(&eval, telex, text, size, text + lookup->pos) < 0) {
+		failed = 1;
+	} else {
+		while (telex_eval_step(eval, 5) == TELEX_EVAL_IN_PROGRESS);
+
+		if (telex_eval_result(eval, &result) < 0) {
+			result = NULL;
+		}
+
+		telex_eval_free(&eval);
+	}
+
+	if (failed || (found ? found - text : -1) != expected ||
+	    (result ? result - text : -1) != expected) {
+		fprintf(stderr, "%s from %zu in %zu bytes: found %ld and %ld, expected %ld\n",
+			input, lookup->pos, size, found ? (long)(found - text) : -1L,
+			result ? (long)(result - text) : -1L, expected);
+		failed = 1;
+	}
+
+	telex_free(&telex);
+	return failed;
+}
+
+static void random_lookup(struct lookup *lookup, const char *text, const size_t size,
+			  char *needle)
+{
+	static const char *prefixes[] = { ">", ">>", "<", "<<" };
+	size_t at;
+	size_t i;
+
+	lookup->prefix = prefixes[next_random() % 4];
+	lookup->backward = lookup->prefix[0] == '<';
+	lookup->nocase = next_random() % 2;
+	lookup->count = next_random() % 4 ? 1 : next_random() % 3 + 2;
+	lookup->scope = next_random() % 3 ? -1 : (int)(next_random() % 3);
+	lookup->len = next_random() % MAX_NEEDLE + 1;
+	lookup->len = lookup->len < size ? lookup->len : size;
+	lookup->pos = lookup->backward ? size - next_random() % (size / 4 + 1) :
+		next_random() % (size / 4 + 1);
+	lookup->needle = needle;
+
+	/* mostly needles that occur, with their case changed */
+	at = next_random() % (size - lookup->len + 1);
+
+	for (i = 0; i < lookup->len; i++) {
+		needle[i] = next_random() % 8 ? text[at + i] :
+			alphabet[next_random() % (sizeof(alphabet) - 1)];
+
+		if (lookup->nocase && next_random() % 2) {
+			needle[i] ^= (needle[i] | 0x20) >= 'a' && (needle[i] | 0x20) <= 'z' ? 0x20 : 0;
+		}
+	}
+}
+
+int main(void)
+{
+	static const size_t blocks[] = { 16, 63, 64, 65, 128, 192 };
+	char needle[MAX_NEEDLE];
+	char text[MAX_TEXT + 1];
+	struct lookup lookup;
+	int failed;
+	size_t size;
+	size_t i;
+	size_t k;
+	int round;
+
+	failed = 0;
+
+	/* needles of letters and their case-bit neighbours across blocks, and at the end */
+	for (k = 0; k < sizeof(blocks) / sizeof(blocks[0]); k++) {
+		static const char *needles[] = { "a@b", "A`B", "[a{", "{A[", "ab\nba" };
+		static const char *prefixes[] = { ">", ">>", "<", "<<" };
+		size_t n;
+		size_t m;
+		int nocase;
+		int end;
+		int p;
+
+		for (n = 0; n < sizeof(needles) / sizeof(needles[0]); n++) {
+			for (end = 0; end < 2; end++) {
+				/* the match ends at the text end, or straddles the block end */
+				size = end ? blocks[k] : MAX_TEXT;
+				memset(text, 'b', size);
+				text[size] = 0;
+				memcpy(text + blocks[k] - strlen(needles[n]) + (end ? 0 : 2),
+				       needles[n], strlen(needles[n]));
+
+				for (m = 0; m < sizeof(needles) / sizeof(needles[0]); m++) {
+					for (nocase = 0; nocase < 2; nocase++) {
+						for (p = 0; p < 4; p++) {
+							lookup.prefix = prefixes[p];
+							lookup.backward = p >= 2;
+							lookup.nocase = nocase;
+							lookup.count = 1;
+							lookup.scope = -1;
+							lookup.needle = needles[m];
+							lookup.len = strlen(needles[m]);
+							lookup.pos = lookup.backward ? size : 0;
+
+							failed |= check(text, size, &lookup);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	for (round = 0; round < ROUNDS && !failed; round++) {
+		size = next_random() % MAX_TEXT + 1;
+
+		for (i = 0; i < size; i++) {
+			text[i] = alphabet[next_random() % (sizeof(alphabet) - 1)];
+		}
+		text[size] = 0;
+
+		random_lookup(&lookup, text, size, needle);
+		failed |= check(text, size, &lookup);
+	}
+
+	printf("lookup: %s\n", failed ? "FAIL" : "OK");
+	return failed;
+}
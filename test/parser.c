@@ -0,0 +1,104 @@
+/*
+ * parser.c - This file is part of libtelex
+ * Copyright (C) 2023 Matthias Kruk
+ *
+ * libtelex is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 3, or (at your
+ * option) any later version.
+ *
+ * libtelex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libtelex; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Parses telexes and ranges that are valid and invalid in small ways and
+ * checks that the parser neither drops nor invents parts of them.
+ */
+
+#include <telex/telex.h>
+#include <telex/error.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+struct parser_test {
+	const char *input;
+	int range;
+	int result;
+	const char *expected;
+};
+
+static const struct parser_test tests[] = {
+	{ "\"AB\"i@1",             0, 0,        "\"AB\"i@1" },
+	{ "\"AB\"@1i",             0, 0,        "\"AB\"i@1" },
+	{ "\"AB\"i@1i",            0, -EBADMSG, NULL },
+	{ "'AB'i",                 0, -EBADMSG, NULL },
+	{ "\"a\")",                0, -EBADMSG, NULL },
+	{ ">\"BEGIN\",>\"END\"",   0, -EBADMSG, NULL },
+	{ ">\"BEGIN\",>\"END\"",   1, 0,        ">\"BEGIN\",>\"END\"" },
+	{ ">\"BEGIN\",>\"END\",",  1, -EBADMSG, NULL },
+	{ ">\"BEGIN\",>\"END\")",  1, -EBADMSG, NULL },
+	{ ":3 > \"a\" \n",         0, 0,        ":3>\"a\"" }
+};
+
+static int run_test(const struct parser_test *test, char *str, const size_t str_size)
+{
+	struct telex_error *errors;
+	struct telex_range *range;
+	struct telex *telex;
+	int result;
+
+	errors = NULL;
+	range = NULL;
+	telex = NULL;
+	str[0] = 0;
+
+	if (test->range) {
+		if (!(result = telex_range_parse(&range, test->input, &errors))) {
+			telex_range_to_string(range, str, str_size);
+			telex_range_free(&range);
+		}
+	} else {
+		if (!(result = telex_parse(&telex, test->input, &errors))) {
+			telex_to_string(telex, str, str_size);
+			telex_free(&telex);
+		}
+	}
+
+	telex_error_free_all(&errors);
+	return result;
+}
+
+int main(void)
+{
+	char str[256];
+	int failed;
+	int i;
+
+	failed = 0;
+
+	for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+		int result;
+
+		result = run_test(&tests[i], str, sizeof(str));
+
+		if (result != tests[i].result ||
+		    (tests[i].expected && strcmp(str, tests[i].expected))) {
+			fprintf(stderr, "%s: returned %d (%s), expected %d (%s)\n",
+				tests[i].input, result, str, tests[i].result,
+				tests[i].expected ? tests[i].expected : "");
+			failed = 1;
+		}
+	}
+
+	printf("parser: %s\n", failed ? "FAIL" : "OK");
+	return failed;
+}